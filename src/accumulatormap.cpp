@@ -4,8 +4,10 @@
 
 #include "accumulatormap.h"
 #include "accumulators.h"
+#include "checkqueue.h"
 #include "main.h"
 #include "txdb.h"
+#include "util.h"
 #include "libzerocoin/Denominations.h"
 
 using namespace libzerocoin;
@@ -61,6 +63,92 @@ bool AccumulatorMap::Accumulate(PublicCoin pubCoin, bool fSkipValidation)
     return true;
 }
 
+/**
+ * Closure adding a run of pubcoins of one denomination to its accumulator.
+ * Since acc^a^b = acc^(a*b) mod N, the coin values are multiplied into one
+ * exponent per ACCUMULATE_MAX_BATCH coins instead of one exponentiation each.
+ */
+class CAccumulateCheck
+{
+private:
+    Accumulator* paccumulator;
+    vector<PublicCoin> vPubcoins;
+    bool fSkipValidation;
+
+public:
+    CAccumulateCheck() : paccumulator(NULL), fSkipValidation(true) {}
+    CAccumulateCheck(Accumulator* paccumulatorIn, bool fSkipValidationIn) : paccumulator(paccumulatorIn), fSkipValidation(fSkipValidationIn) {}
+
+    void Add(const PublicCoin& pubcoin) { vPubcoins.push_back(pubcoin); }
+
+    bool operator()()
+    {
+        try {
+            if (!fSkipValidation) {
+                if (!paccumulator->getValue())
+                    return false;
+                for (const PublicCoin& pubcoin : vPubcoins) {
+                    if (!pubcoin.validate())
+                        return false;
+                }
+            }
+
+            for (unsigned int i = 0; i < vPubcoins.size(); i += ACCUMULATE_MAX_BATCH) {
+                CBigNum bnExponent = vPubcoins[i].getValue();
+                for (unsigned int j = i + 1; j < vPubcoins.size() && j < i + ACCUMULATE_MAX_BATCH; j++)
+                    bnExponent *= vPubcoins[j].getValue();
+                paccumulator->increment(bnExponent);
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("CAccumulateCheck() : %s\n", e.what());
+            return false;
+        }
+        return true;
+    }
+
+    void swap(CAccumulateCheck& check)
+    {
+        std::swap(paccumulator, check.paccumulator);
+        vPubcoins.swap(check.vPubcoins);
+        std::swap(fSkipValidation, check.fSkipValidation);
+    }
+};
+
+static CCheckQueue<CAccumulateCheck> accumulatequeue(1, &checkqueuehost);
+/** Only one master may drive the accumulate queue at a time */
+static CCriticalSection cs_accumulatequeue;
+
+//Add a list of zerocoins to the accumulators of their denominations, one denomination per verification worker.
+bool AccumulatorMap::Accumulate(const vector<PublicCoin>& vPubcoins, bool fSkipValidation)
+{
+    map<CoinDenomination, CAccumulateCheck> mapChecks;
+    for (const PublicCoin& pubcoin : vPubcoins) {
+        CoinDenomination denom = pubcoin.getDenomination();
+        if (denom == CoinDenomination::ZQ_ERROR)
+            return false;
+
+        if (!mapChecks.count(denom))
+            mapChecks.insert(make_pair(denom, CAccumulateCheck(mapAccumulators.at(denom).get(), fSkipValidation)));
+        mapChecks.at(denom).Add(pubcoin);
+    }
+
+    if (mapChecks.empty())
+        return true;
+
+    vector<CAccumulateCheck> vChecks;
+    vChecks.reserve(mapChecks.size());
+    for (auto& it : mapChecks) {
+        vChecks.push_back(CAccumulateCheck());
+        vChecks.back().swap(it.second);
+    }
+
+    //the master processes the queue itself while waiting, so this also works without worker threads
+    LOCK(cs_accumulatequeue);
+    CCheckQueueControl<CAccumulateCheck> control(&accumulatequeue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 //Get the value of a specific accumulator
 CBigNum AccumulatorMap::GetValue(CoinDenomination denom)
 {
@@ -7,6 +7,11 @@
 #include "libzerocoin/Accumulator.h"
 #include "libzerocoin/Coin.h"
 
+#include <vector>
+
+//! maximum number of pubcoins whose values are multiplied into a single exponent when accumulating a run of mints
+static const unsigned int ACCUMULATE_MAX_BATCH = 64;
+
 //A map with an accumulator for each denomination
 class AccumulatorMap
 {
@@ -16,8 +21,10 @@ public:
     AccumulatorMap();
     bool Load(uint256 nCheckpoint);
     bool Accumulate(libzerocoin::PublicCoin pubCoin, bool fSkipValidation = false);
+    bool Accumulate(const std::vector<libzerocoin::PublicCoin>& vPubcoins, bool fSkipValidation = false);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
     uint256 GetCheckpoint();
     void Reset();
 };
+
 #endif //PIVX_ACCUMULATORMAP_H
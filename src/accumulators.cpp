@@ -201,6 +201,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         }
     }
 
+    std::vector<PublicCoin> vPubcoins;
     while (pindex->nHeight < nHeight - 10) {
         // checking whether we should stop this process due to a shutdown request
         if (ShutdownRequested()) {
@@ -214,28 +215,23 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         }
 
         //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex)) {
-            return error("%s: failed to read block from disk\n", __func__);
-        }
-
-        std::list<PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid)) {
+        std::list<CZerocoinMint> listMints;
+        if (!GetBlockMints(pindex, listMints, fFilterInvalid)) {
             return error("%s: failed to get zerocoin mintlist from block %d\n", __func__, pindex->nHeight);
         }
 
-        nTotalMintsFound += listPubcoins.size();
-        LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
+        nTotalMintsFound += listMints.size();
+        LogPrint("zero", "%s found %d mints\n", __func__, listMints.size());
 
-        //add the pubcoins to accumulator
-        for (const PublicCoin pubcoin : listPubcoins) {
-            if(!mapAccumulators.Accumulate(pubcoin, true)) {
-                return error("%s: failed to add pubcoin to accumulator at height %n\n", __func__, pindex->nHeight);
-            }
-        }
+        for (const CZerocoinMint& mint : listMints)
+            vPubcoins.emplace_back(PublicCoin(Params().Zerocoin_Params(), mint.GetValue(), mint.GetDenomination()));
         pindex = chainActive.Next(pindex);
     }
 
+    //add the pubcoins of all ten blocks to the accumulators at once
+    if (!mapAccumulators.Accumulate(vPubcoins, true))
+        return error("%s: failed to add pubcoins to accumulators at height %d\n", __func__, nHeight);
+
     // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
     if (nTotalMintsFound == 0)
         nCheckpoint = chainActive[nHeight - 1]->nAccumulatorCheckpoint;
@@ -296,132 +292,181 @@ bool ValidateAccumulatorCheckpoint(const CBlock& block, CBlockIndex* pindex, Acc
     return true;
 }
 
-bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError)
+bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, CAccumulatorWitnessCache* pcache)
 {
-    uint256 txid;
-    if (!zerocoinDB->ReadCoinMint(coin.getValue(), txid)) {
-        LogPrint("zero","%s failed to read mint from db\n", __func__);
-        return false;
-    }
+    // The blocks whose mints go into the witness are found under cs_main, the mints are added without taking it.
+    // Only ThreadZerocoinWitnesses gains from that, MintToTxIn calls this holding cs_main.
+    int nHeightMintAdded;
+    int nAccStartHeight;
+    int nHeightEnd;
+    vector<const CBlockIndex*> vBlocksWithMints;
+    bool fCacheValid = false;
+    bool fResume = false;
+    uint256 hashBlockEnd;
+    {
+        LOCK(cs_main);
+        uint256 txid;
+        if (!zerocoinDB->ReadCoinMint(coin.getValue(), txid)) {
+            LogPrint("zero","%s failed to read mint from db\n", __func__);
+            return false;
+        }
 
-    CTransaction txMinted;
-    uint256 hashBlock;
-    if (!GetTransaction(txid, txMinted, hashBlock)) {
-        LogPrint("zero","%s failed to read tx\n", __func__);
-        return false;
-    }
+        CTransaction txMinted;
+        uint256 hashBlock;
+        if (!GetTransaction(txid, txMinted, hashBlock)) {
+            LogPrint("zero","%s failed to read tx\n", __func__);
+            return false;
+        }
 
-    int nHeightMintAdded= mapBlockIndex[hashBlock]->nHeight;
-    uint256 nCheckpointBeforeMint = 0;
-    CBlockIndex* pindex = chainActive[nHeightMintAdded];
-    int nChanges = 0;
+        nHeightMintAdded = mapBlockIndex[hashBlock]->nHeight;
+        uint256 nCheckpointBeforeMint = 0;
+        CBlockIndex* pindex = chainActive[nHeightMintAdded];
+        int nChanges = 0;
 
-    //find the checksum when this was added to the accumulator officially, which will be two checksum changes later
-    //reminder that checksums are generated when the block height is a multiple of 10
-    while (pindex->nHeight < chainActive.Tip()->nHeight - 1) {
-        if (pindex->nHeight == nHeightMintAdded) {
-            pindex = chainActive[pindex->nHeight + 1];
-            continue;
-        }
+        //find the checksum when this was added to the accumulator officially, which will be two checksum changes later
+        //reminder that checksums are generated when the block height is a multiple of 10
+        while (pindex->nHeight < chainActive.Tip()->nHeight - 1) {
+            if (pindex->nHeight == nHeightMintAdded) {
+                pindex = chainActive[pindex->nHeight + 1];
+                continue;
+            }
 
-        //check if the next checksum was generated
-        if (pindex->nHeight % 10 == 0) {
-            nChanges++;
+            //check if the next checksum was generated
+            if (pindex->nHeight % 10 == 0) {
+                nChanges++;
 
-            if (nChanges == 1) {
-                nCheckpointBeforeMint = pindex->nAccumulatorCheckpoint;
-                break;
+                if (nChanges == 1) {
+                    nCheckpointBeforeMint = pindex->nAccumulatorCheckpoint;
+                    break;
+                }
             }
+            pindex = chainActive.Next(pindex);
         }
-        pindex = chainActive.Next(pindex);
-    }
 
-    //the height to start accumulating coins to add to witness
-    int nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
+        //the height to start accumulating coins to add to witness
+        nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
 
-    //If the checkpoint is from the recalculated checkpoint period, then adjust it
-    int nHeight_LastGoodCheckpoint = Params().Zerocoin_Block_LastGoodCheckpoint();
-    int nHeight_Recalculate = Params().Zerocoin_Block_RecalculateAccumulators();
-    if (pindex->nHeight < nHeight_Recalculate - 10 && pindex->nHeight > nHeight_LastGoodCheckpoint) {
-        //The checkpoint before the mint will be the last good checkpoint
-        nCheckpointBeforeMint = chainActive[nHeight_LastGoodCheckpoint]->nAccumulatorCheckpoint;
-        nAccStartHeight = nHeight_LastGoodCheckpoint - 10;
-    }
+        //If the checkpoint is from the recalculated checkpoint period, then adjust it
+        int nHeight_LastGoodCheckpoint = Params().Zerocoin_Block_LastGoodCheckpoint();
+        int nHeight_Recalculate = Params().Zerocoin_Block_RecalculateAccumulators();
+        if (pindex->nHeight < nHeight_Recalculate - 10 && pindex->nHeight > nHeight_LastGoodCheckpoint) {
+            //The checkpoint before the mint will be the last good checkpoint
+            nCheckpointBeforeMint = chainActive[nHeight_LastGoodCheckpoint]->nAccumulatorCheckpoint;
+            nAccStartHeight = nHeight_LastGoodCheckpoint - 10;
+        }
 
-    //Get the accumulator that is right before the cluster of blocks containing our mint was added to the accumulator
-    CBigNum bnAccValue = 0;
-    if (GetAccumulatorValueFromDB(nCheckpointBeforeMint, coin.getDenomination(), bnAccValue)) {
-        if (bnAccValue > 0) {
-            accumulator.setValue(bnAccValue);
-            witness.resetValue(accumulator, coin);
+        //Get the accumulator that is right before the cluster of blocks containing our mint was added to the accumulator
+        CBigNum bnAccValue = 0;
+        if (GetAccumulatorValueFromDB(nCheckpointBeforeMint, coin.getDenomination(), bnAccValue)) {
+            if (bnAccValue > 0) {
+                accumulator.setValue(bnAccValue);
+                witness.resetValue(accumulator, coin);
+            }
         }
-    }
 
-    //security level: this is an important prevention of tracing the coins via timing. Security level represents how many checkpoints
-    //of accumulated coins are added *beyond* the checkpoint that the mint being spent was added too. If each spend added the exact same
-    //amounts of checkpoints after the mint was accumulated, then you could know the range of blocks that the mint originated from.
-    if (nSecurityLevel < 100) {
-        //add some randomness to the user's selection so that it is not always the same
-        nSecurityLevel += CBigNum::randBignum(10).getint();
+        //security level: this is an important prevention of tracing the coins via timing. Security level represents how many checkpoints
+        //of accumulated coins are added *beyond* the checkpoint that the mint being spent was added too. If each spend added the exact same
+        //amounts of checkpoints after the mint was accumulated, then you could know the range of blocks that the mint originated from.
+        if (nSecurityLevel < 100) {
+            //add some randomness to the user's selection so that it is not always the same
+            nSecurityLevel += CBigNum::randBignum(10).getint();
 
-        //security level 100 represents adding all available coins that have been accumulated - user did not select this
-        if (nSecurityLevel >= 100)
-            nSecurityLevel = 99;
-    }
+            //security level 100 represents adding all available coins that have been accumulated - user did not select this
+            if (nSecurityLevel >= 100)
+                nSecurityLevel = 99;
+        }
 
-    //add the pubcoins (zerocoinmints that have been published to the chain) up to the next checksum starting from the block
-    pindex = chainActive[nAccStartHeight];
-    int nChainHeight = chainActive.Height();
-    int nHeightStop = nChainHeight % 10;
-    nHeightStop = nChainHeight - nHeightStop - 20; // at least two checkpoints deep
-    int nCheckpointsAdded = 0;
-    nMintsAdded = 0;
-    while (pindex->nHeight < nHeightStop + 1) {
-        if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
-            ++nCheckpointsAdded;
-
-        //if a new checkpoint was generated on this block, and we have added the specified amount of checkpointed accumulators,
-        //then initialize the accumulator at this point and break
-        if (!InvalidCheckpointRange(pindex->nHeight) && (pindex->nHeight >= nHeightStop || (nSecurityLevel != 100 && nCheckpointsAdded >= nSecurityLevel))) {
-            uint32_t nChecksum = ParseChecksum(chainActive[pindex->nHeight + 10]->nAccumulatorCheckpoint, coin.getDenomination());
-            CBigNum bnAccValue = 0;
-            if (!zerocoinDB->ReadAccumulatorValue(nChecksum, bnAccValue)) {
-                LogPrintf("%s : failed to find checksum in database for accumulator\n", __func__);
-                return false;
+        //add the pubcoins (zerocoinmints that have been published to the chain) up to the next checksum starting from the block
+        pindex = chainActive[nAccStartHeight];
+        int nChainHeight = chainActive.Height();
+        int nHeightStop = nChainHeight % 10;
+        nHeightStop = nChainHeight - nHeightStop - 20; // at least two checkpoints deep
+        int nCheckpointsAdded = 0;
+        while (pindex->nHeight < nHeightStop + 1) {
+            if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
+                ++nCheckpointsAdded;
+
+            //if a new checkpoint was generated on this block, and we have added the specified amount of checkpointed accumulators,
+            //then initialize the accumulator at this point and break
+            if (!InvalidCheckpointRange(pindex->nHeight) && (pindex->nHeight >= nHeightStop || (nSecurityLevel != 100 && nCheckpointsAdded >= nSecurityLevel))) {
+                uint32_t nChecksum = ParseChecksum(chainActive[pindex->nHeight + 10]->nAccumulatorCheckpoint, coin.getDenomination());
+                CBigNum bnAccValue = 0;
+                if (!zerocoinDB->ReadAccumulatorValue(nChecksum, bnAccValue)) {
+                    LogPrintf("%s : failed to find checksum in database for accumulator\n", __func__);
+                    return false;
+                }
+                accumulator.setValue(bnAccValue);
+                break;
             }
-            accumulator.setValue(bnAccValue);
-            break;
+
+            // if this block contains mints of the denomination that is being spent, then add them to the witness
+            if (pindex->MintedDenomination(coin.getDenomination()))
+                vBlocksWithMints.push_back(pindex);
+
+            pindex = chainActive[pindex->nHeight + 1];
         }
+        nHeightEnd = pindex->nHeight;
+        hashBlockEnd = pindex->pprev->GetBlockHash();
 
-        // if this block contains mints of the denomination that is being spent, then add them to the witness
-        if (pindex->MintedDenomination(coin.getDenomination())) {
-            //grab mints from this block
-            CBlock block;
-            if(!ReadBlockFromDisk(block, pindex)) {
-                LogPrintf("%s: failed to read block from disk while adding pubcoins to witness\n", __func__);
-                return false;
-            }
+        // the cached witness can be continued if it has not gone past where this one stops
+        if (pcache)
+            fCacheValid = pcache->AppliesTo(nAccStartHeight, chainActive);
+        fResume = fCacheValid && pcache->nHeightAccumulated <= nHeightEnd;
+    }
 
-            list<PublicCoin> listPubcoins;
-            if(!BlockToPubcoinList(block, listPubcoins, true)) {
-                LogPrintf("%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
-                return false;
-            }
+    nMintsAdded = 0;
+    int nHeightResume = nAccStartHeight;
+    if (fResume) {
+        Accumulator accumulatorCached(Params().Zerocoin_Params(), coin.getDenomination(), pcache->bnWitness);
+        witness.resetValue(accumulatorCached, coin);
+        nMintsAdded = pcache->nMintsAdded;
+        nHeightResume = pcache->nHeightAccumulated;
+    }
 
-            //add the mints to the witness
-            for (const PublicCoin pubcoin : listPubcoins) {
-                if (pubcoin.getDenomination() != coin.getDenomination())
-                    continue;
+    CBigNum bnBatch;
+    unsigned int nBatched = 0;
+    for (const CBlockIndex* pindexMints : vBlocksWithMints) {
+        if (pindexMints->nHeight < nHeightResume)
+            continue;
 
-                if (pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
-                    continue;
+        //grab mints from this block
+        list<CZerocoinMint> listMints;
+        if (!GetBlockMints(pindexMints, listMints, true)) {
+            LogPrintf("%s: failed to get zerocoin mintlist from block %d\n", __func__, pindexMints->nHeight);
+            return false;
+        }
+
+        //add the mints to the witness, multiplying runs of values into one exponent
+        for (const CZerocoinMint& mint : listMints) {
+            if (mint.GetDenomination() != coin.getDenomination())
+                continue;
 
-                witness.addRawValue(pubcoin.getValue());
-                ++nMintsAdded;
+            if (pindexMints->nHeight == nHeightMintAdded && mint.GetValue() == coin.getValue())
+                continue;
+
+            if (nBatched == 0)
+                bnBatch = mint.GetValue();
+            else
+                bnBatch *= mint.GetValue();
+            ++nMintsAdded;
+
+            if (++nBatched == ACCUMULATE_MAX_BATCH) {
+                witness.addRawValue(bnBatch);
+                nBatched = 0;
             }
         }
-
-        pindex = chainActive[pindex->nHeight + 1];
+    }
+    if (nBatched > 0)
+        witness.addRawValue(bnBatch);
+    LogPrint("zero", "%s : added mints of blocks %d to %d, %d from cache\n", __func__, nHeightResume, nHeightEnd, nHeightResume - nAccStartHeight);
+
+    // keep the furthest witness in the cache
+    if (pcache && (fResume || !fCacheValid)) {
+        pcache->nHeightAccStart = nAccStartHeight;
+        pcache->nHeightAccumulated = nHeightEnd;
+        pcache->hashBlockLast = hashBlockEnd;
+        pcache->bnWitness = witness.getValue();
+        pcache->nMintsAdded = nMintsAdded;
     }
 
     if (nMintsAdded < Params().Zerocoin_RequiredAccumulation()) {
@@ -431,8 +476,9 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     }
 
     // calculate how many mints of this denomination existed in the accumulator we initialized
+    LOCK(cs_main);
     int nZerocoinStartHeight = GetZerocoinStartHeight();
-    pindex = chainActive[nZerocoinStartHeight];
+    CBlockIndex* pindex = chainActive[nZerocoinStartHeight];
     while (pindex->nHeight < nAccStartHeight) {
         nMintsAdded += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), coin.getDenomination());
         pindex = chainActive[pindex->nHeight + 1];
@@ -13,7 +13,59 @@
 #include "chain.h"
 #include "uint256.h"
 
-bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError);
+/**
+ * A coin's witness with the mints of the blocks in [nHeightAccStart,
+ * nHeightAccumulated) added, kept by the wallet so that the next witness
+ * for the coin only adds the mints since.
+ */
+class CAccumulatorWitnessCache
+{
+public:
+    int nHeightAccStart;
+    int nHeightAccumulated;
+    uint256 hashBlockLast; //!< block at nHeightAccumulated - 1, to notice reorganizations
+    CBigNum bnWitness;
+    int nMintsAdded;
+
+    CAccumulatorWitnessCache()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nHeightAccStart = 0;
+        nHeightAccumulated = 0;
+        hashBlockLast = 0;
+        bnWitness = 0;
+        nMintsAdded = 0;
+    }
+
+    bool IsNull() const { return nHeightAccumulated == 0; }
+
+    //! Whether a witness starting at nHeightAccStartIn can continue from this one, i.e. its blocks are still in chain
+    bool AppliesTo(int nHeightAccStartIn, const CChain& chain) const
+    {
+        if (IsNull() || nHeightAccStart != nHeightAccStartIn || nHeightAccumulated > chain.Height() + 1)
+            return false;
+        // any reorganization of the accumulated blocks replaces the last of them
+        return chain[nHeightAccumulated - 1]->GetBlockHash() == hashBlockLast;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nHeightAccStart);
+        READWRITE(nHeightAccumulated);
+        READWRITE(hashBlockLast);
+        READWRITE(bnWitness);
+        READWRITE(nMintsAdded);
+    };
+};
+
+//! If pcache is given, start from it when it still applies, and leave the new witness in it
+bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CAccumulatorWitnessCache* pcache = NULL);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
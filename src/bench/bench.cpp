@@ -0,0 +1,77 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "utiltime.h"
+
+#include <iomanip>
+#include <iostream>
+
+benchmark::BenchRunner::BenchmarkMap& benchmark::BenchRunner::benchmarks()
+{
+    static std::map<std::string, benchmark::BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+benchmark::BenchRunner::BenchRunner(const std::string& name, benchmark::BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+void benchmark::BenchRunner::RunAll(const std::string& strFilter, int64_t nMaxElapsed, const std::map<std::string, double>& mapBaseline)
+{
+    std::cout << "# Benchmark, iterations, ns/op, min ns/op, max ns/op";
+    if (!mapBaseline.empty())
+        std::cout << ", baseline ns/op, change %";
+    std::cout << "\n";
+
+    for (BenchmarkMap::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it) {
+        if (it->first.find(strFilter) == std::string::npos)
+            continue;
+        State state(it->first, nMaxElapsed);
+        it->second(state);
+        const Result& result = state.GetResult();
+
+        std::cout << std::fixed << std::setprecision(1) << it->first << "," << result.nIterations << ","
+                  << result.dAverage << "," << result.dMin << "," << result.dMax;
+        std::map<std::string, double>::const_iterator itBaseline = mapBaseline.find(it->first);
+        if (itBaseline != mapBaseline.end() && itBaseline->second > 0)
+            std::cout << "," << itBaseline->second << "," << std::showpos << 100.0 * (result.dAverage - itBaseline->second) / itBaseline->second << std::noshowpos;
+        std::cout << std::endl;
+    }
+}
+
+bool benchmark::State::KeepRunning()
+{
+    int64_t nNow;
+    if (nCount == 0) {
+        nBeginTime = nNow = GetTimeMicros();
+    } else {
+        if ((nCount + 1) % nTimeCheckCount != 0) {
+            ++nCount;
+            return true; // keep going
+        }
+        nNow = GetTimeMicros();
+        double dElapsedOne = 1000.0 * (nNow - nLastTime) / (nCount + 1 - nLastCount);
+        if (result.dMin == 0 || dElapsedOne < result.dMin)
+            result.dMin = dElapsedOne;
+        if (dElapsedOne > result.dMax)
+            result.dMax = dElapsedOne;
+        // Read the clock less often once a batch takes well under the time budget
+        if ((nNow - nLastTime) * 16 < nMaxElapsed)
+            nTimeCheckCount *= 2;
+    }
+    nLastTime = nNow;
+    nLastCount = ++nCount;
+
+    if (nNow - nBeginTime < nMaxElapsed)
+        return true; // keep going
+
+    --nCount;
+    result.nIterations = nCount;
+    result.dAverage = nCount ? 1000.0 * (nNow - nBeginTime) / nCount : 0;
+    return false;
+}
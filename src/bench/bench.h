@@ -0,0 +1,95 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <map>
+#include <string>
+
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+#include <stdint.h>
+
+// Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
+// framework (see https://github.com/google/benchmark)
+// Why not use the Google Benchmark framework? Because adding Yet Another Dependency
+// (that uses cmake as its build system and has lots of features we don't need) isn't
+// worth it.
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ */
+
+namespace benchmark
+{
+//! Timing of one benchmark, in nanoseconds per operation
+struct Result {
+    uint64_t nIterations;
+    double dAverage;
+    double dMin;
+    double dMax;
+
+    Result() : nIterations(0), dAverage(0), dMin(0), dMax(0) {}
+};
+
+class State
+{
+    std::string name;
+    int64_t nMaxElapsed;     //!< in microseconds
+    int64_t nBeginTime;
+    int64_t nLastTime;
+    uint64_t nCount;
+    uint64_t nLastCount;
+    //! The clock is only read every nTimeCheckCount iterations, so that very
+    //! fast operations are not dominated by the cost of reading it
+    uint64_t nTimeCheckCount;
+    Result result;
+
+public:
+    State(const std::string& nameIn, int64_t nMaxElapsedIn) : name(nameIn), nMaxElapsed(nMaxElapsedIn), nBeginTime(0), nLastTime(0), nCount(0), nLastCount(0), nTimeCheckCount(1) {}
+    bool KeepRunning();
+
+    const Result& GetResult() const { return result; }
+};
+
+typedef void (*BenchFunction)(State&);
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(const std::string& name, BenchFunction func);
+
+    /**
+     * Run every benchmark whose name contains strFilter for about nMaxElapsed
+     * microseconds each, printing one CSV line per benchmark. Benchmarks found
+     * in mapBaseline (ns/op by name, as read from an earlier run) are printed
+     * with their change relative to it.
+     */
+    static void RunAll(const std::string& strFilter, int64_t nMaxElapsed, const std::map<std::string, double>& mapBaseline);
+};
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
@@ -0,0 +1,65 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "script/sigcache.h"
+#include "util.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+
+#include <boost/algorithm/string.hpp>
+
+/** Read the ns/op column of an earlier run's output */
+static bool ReadBaseline(const std::string& strFile, std::map<std::string, double>& mapBaseline)
+{
+    std::ifstream file(strFile.c_str());
+    if (!file.is_open())
+        return false;
+    std::string strLine;
+    while (std::getline(file, strLine)) {
+        if (strLine.empty() || strLine[0] == '#')
+            continue;
+        std::vector<std::string> vFields;
+        boost::split(vFields, strLine, boost::is_any_of(","));
+        if (vFields.size() >= 3)
+            mapBaseline[vFields[0]] = atof(vFields[2].c_str());
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help")) {
+        std::string strUsage = "Usage:\n  bench_opcx [options]\n\n";
+        strUsage += HelpMessageGroup("Options:");
+        strUsage += HelpMessageOpt("-?", "This help message");
+        strUsage += HelpMessageOpt("-filter=<name>", "Only run benchmarks whose name contains <name>");
+        strUsage += HelpMessageOpt("-time=<n>", strprintf("Run each benchmark for about <n> milliseconds (default: %u)", 1000));
+        strUsage += HelpMessageOpt("-compare=<file>", "Report the change against an earlier run's output saved in <file>");
+        fprintf(stdout, "%s", strUsage.c_str());
+        return 0;
+    }
+
+    std::map<std::string, double> mapBaseline;
+    if (mapArgs.count("-compare") && !ReadBaseline(mapArgs["-compare"], mapBaseline)) {
+        fprintf(stderr, "Error: cannot read %s\n", mapArgs["-compare"].c_str());
+        return 1;
+    }
+
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::UNITTEST);
+    InitSignatureCache();
+
+    benchmark::BenchRunner::RunAll(GetArg("-filter", ""), GetArg("-time", 1000) * 1000, mapBaseline);
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+#include <assert.h>
+
+//! A block of 1000 two-in two-out transactions with random prevouts and scripts
+static CBlock CreateTestBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1514764800;
+    block.nBits = 0x1e0ffff0;
+    for (int i = 0; i < 1000; i++) {
+        CMutableTransaction tx;
+        for (int j = 0; j < 2; j++) {
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), j)));
+            tx.vin.back().scriptSig = CScript() << std::vector<unsigned char>(72, j) << std::vector<unsigned char>(33, j);
+            std::vector<unsigned char> vchKeyHash(20);
+            GetRandBytes(vchKeyHash.data(), vchKeyHash.size());
+            tx.vout.push_back(CTxOut(GetRand(1000) * COIN, CScript() << OP_DUP << OP_HASH160 << vchKeyHash << OP_EQUALVERIFY << OP_CHECKSIG));
+        }
+        block.vtx.push_back(CTransaction(tx));
+    }
+    return block;
+}
+
+static void BlockBuildMerkleTree(benchmark::State& state)
+{
+    CBlock block = CreateTestBlock();
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+static void BlockSerialize(benchmark::State& state)
+{
+    CBlock block = CreateTestBlock();
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    while (state.KeepRunning()) {
+        stream.clear();
+        stream << block;
+    }
+}
+
+// Includes the hashing of every transaction, which deserialization triggers
+static void BlockDeserialize(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CreateTestBlock();
+    const std::vector<char> vData(stream.begin(), stream.end());
+    while (state.KeepRunning()) {
+        CDataStream streamIn(vData, SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        streamIn >> block;
+        assert(block.vtx.size() == 1000);
+    }
+}
+
+BENCHMARK(BlockBuildMerkleTree);
+BENCHMARK(BlockSerialize);
+BENCHMARK(BlockDeserialize);
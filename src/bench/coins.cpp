@@ -0,0 +1,38 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+#include "script/script.h"
+
+#include <assert.h>
+#include <vector>
+
+// Look up cached transactions in a coins cache of 100000 entries, as
+// ConnectBlock does for every input
+static void CoinsCacheLookup(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    std::vector<uint256> vTxid(100000);
+    for (unsigned int i = 0; i < vTxid.size(); i++) {
+        vTxid[i] = GetRandHash();
+        CCoinsModifier coins = cache.ModifyCoins(vTxid[i]);
+        coins->nVersion = 1;
+        coins->nHeight = i;
+        coins->vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+        coins->vout.push_back(CTxOut(10 * COIN, CScript() << OP_TRUE));
+    }
+
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        const CCoins* coins = cache.AccessCoins(vTxid[i]);
+        assert(coins != NULL);
+        i = (i + 7919) % vTxid.size();
+    }
+}
+
+BENCHMARK(CoinsCacheLookup);
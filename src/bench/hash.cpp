@@ -0,0 +1,48 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "primitives/block.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+// Proof-of-work hash of one block header
+static void HashQuark80(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.nTime = 1514764800;
+    header.nBits = 0x1e0ffff0;
+    uint256 hash;
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        hash = HashQuark(BEGIN(header.nVersion), END(header.nNonce));
+    }
+}
+
+// Double SHA256 of two child hashes, as for a merkle tree node
+static void CHash256_64(benchmark::State& state)
+{
+    std::vector<unsigned char> in(64, 0);
+    unsigned char hash[CHash256::OUTPUT_SIZE];
+    while (state.KeepRunning()) {
+        CHash256().Write(in.data(), in.size()).Finalize(hash);
+        in[0] = hash[0];
+    }
+}
+
+static void CHash256_1M(benchmark::State& state)
+{
+    std::vector<unsigned char> in(1024 * 1024, 0);
+    unsigned char hash[CHash256::OUTPUT_SIZE];
+    while (state.KeepRunning())
+        CHash256().Write(in.data(), in.size()).Finalize(hash);
+}
+
+BENCHMARK(HashQuark80);
+BENCHMARK(CHash256_64);
+BENCHMARK(CHash256_1M);
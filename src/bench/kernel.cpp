@@ -0,0 +1,46 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "kernel.h"
+#include "random.h"
+
+// One attempt of the CheckStakeKernelHash search: the kernel hash for a
+// timestamp and its comparison against the weighted target. The full
+// function needs a chain long enough to select a stake modifier, so the
+// benchmark times the step it repeats for every timestamp in the drift.
+static void StakeKernelHash(benchmark::State& state)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << (uint64_t)0x0123456789abcdefULL;
+    const uint256 hashPrevout = GetRandHash();
+    const unsigned int nTimeBlockFrom = 1514764800;
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(0x1e0ffff0);
+    unsigned int nTimeTx = nTimeBlockFrom + 60 * 60 * 24;
+    unsigned int nHits = 0;
+    while (state.KeepRunning()) {
+        uint256 hashProofOfStake = stakeHash(nTimeTx++, ss, 1, hashPrevout, nTimeBlockFrom);
+        if (stakeTargetHit(hashProofOfStake, 1000 * COIN, bnTargetPerCoinDay))
+            nHits++;
+    }
+}
+
+// The same attempt with the constant part of the kernel prepared, as FindStakeKernel does
+static void StakeKernelHashPrepared(benchmark::State& state)
+{
+    const unsigned int nTimeBlockFrom = 1514764800;
+    const CStakeKernel kernel(0x0123456789abcdefULL, nTimeBlockFrom, COutPoint(GetRandHash(), 1), 1000 * COIN, 0x1e0ffff0);
+    unsigned int nTimeTx = nTimeBlockFrom + 60 * 60 * 24;
+    unsigned int nHits = 0;
+    while (state.KeepRunning()) {
+        uint256 hashProofOfStake;
+        if (kernel.CheckHash(nTimeTx++, hashProofOfStake))
+            nHits++;
+    }
+}
+
+BENCHMARK(StakeKernelHash);
+BENCHMARK(StakeKernelHashPrepared);
@@ -0,0 +1,44 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+#include <assert.h>
+
+// Verify the signature of a pay-to-pubkey-hash input. Nothing is stored in
+// the signature cache, so every iteration does the full ECDSA verification.
+static void ScriptCheckP2PKH(benchmark::State& state)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CMutableTransaction txCredit;
+    txCredit.vin.push_back(CTxIn());
+    txCredit.vout.push_back(CTxOut(50 * COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    CCoins coins(CTransaction(txCredit), 1);
+
+    CMutableTransaction txSpendMutable;
+    txSpendMutable.vin.push_back(CTxIn(COutPoint(txCredit.GetHash(), 0)));
+    txSpendMutable.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    bool fSigned = SignSignature(keystore, txCredit.vout[0].scriptPubKey, txSpendMutable, 0);
+    assert(fSigned);
+    const CTransaction txSpend(txSpendMutable);
+
+    while (state.KeepRunning()) {
+        CScriptCheck check(coins, txSpend, 0, STANDARD_SCRIPT_VERIFY_FLAGS, false);
+        bool fValid = check();
+        assert(fValid);
+    }
+}
+
+BENCHMARK(ScriptCheckP2PKH);
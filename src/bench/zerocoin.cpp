@@ -0,0 +1,49 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "accumulators.h"
+#include "chainparams.h"
+#include "libzerocoin/Accumulator.h"
+#include "libzerocoin/Coin.h"
+#include "libzerocoin/CoinSpend.h"
+
+#include <assert.h>
+
+using namespace libzerocoin;
+
+// Add one mint to an accumulator, including the validation of the public coin
+static void AccumulatorAccumulate(benchmark::State& state)
+{
+    const ZerocoinParams* params = Params().Zerocoin_Params();
+    PrivateCoin coin(params, CoinDenomination::ZQ_ONE);
+    Accumulator accumulator(params, CoinDenomination::ZQ_ONE);
+    while (state.KeepRunning())
+        accumulator.accumulate(coin.getPublicCoin());
+}
+
+// Verify the proofs of a zerocoin spend against its accumulator
+static void CoinSpendVerify(benchmark::State& state)
+{
+    const ZerocoinParams* params = Params().Zerocoin_Params();
+    PrivateCoin coin(params, CoinDenomination::ZQ_ONE);
+    Accumulator accumulator(params, CoinDenomination::ZQ_ONE);
+    AccumulatorWitness witness(params, accumulator, coin.getPublicCoin());
+    for (int i = 0; i < 3; i++) {
+        PrivateCoin coinOther(params, CoinDenomination::ZQ_ONE);
+        accumulator += coinOther.getPublicCoin();
+        witness += coinOther.getPublicCoin();
+    }
+    accumulator += coin.getPublicCoin();
+
+    CoinSpend spend(params, coin, accumulator, GetChecksum(accumulator.getValue()), witness, 0);
+    while (state.KeepRunning()) {
+        bool fValid = spend.Verify(accumulator);
+        assert(fValid);
+    }
+}
+
+BENCHMARK(AccumulatorAccumulate);
+BENCHMARK(CoinSpendVerify);
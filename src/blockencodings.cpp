@@ -0,0 +1,163 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <limits>
+
+#include <boost/unordered_map.hpp>
+
+//! Smallest serialized transaction, bounds the transaction count of a block
+static const unsigned int MIN_TRANSACTION_SIZE = 10;
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+                                                                             header(block.GetBlockHeader()),
+                                                                             vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+
+    // The coinbase, and the coinstake of proof-of-stake blocks, are never in a mempool
+    size_t nPrefilled = std::min(block.vtx.size(), (size_t)(block.IsProofOfStake() ? 2 : 1));
+    prefilledtxn.reserve(nPrefilled);
+    for (size_t i = 0; i < nPrefilled; i++)
+        prefilledtxn.push_back(PrefilledTransaction(i, block.vtx[i]));
+
+    shorttxids.reserve(block.vtx.size() - nPrefilled);
+    for (size_t i = nPrefilled; i < block.vtx.size(); i++)
+        shorttxids.push_back(GetShortID(block.vtx[i].GetHash()));
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    uint256 hashSelector;
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(hashSelector.begin());
+    shorttxidk0 = hashSelector.Get64(0);
+    shorttxidk1 = hashSelector.Get64(1);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffULL;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool)
+{
+    if (cmpctblock.header.IsNull() || cmpctblock.prefilledtxn.empty())
+        return READ_STATUS_INVALID;
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE_CURRENT / MIN_TRANSACTION_SIZE)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && vtx.empty());
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    vtx.resize(cmpctblock.BlockTxCount());
+    vAvailable.assign(vtx.size(), false);
+    nPrefilled = 0;
+    nFromMempool = 0;
+
+    for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
+        const PrefilledTransaction& prefilled = cmpctblock.prefilledtxn[i];
+        if (prefilled.index >= vtx.size() || vAvailable[prefilled.index] || prefilled.tx.IsNull())
+            return READ_STATUS_INVALID;
+        vtx[prefilled.index] = prefilled.tx;
+        vAvailable[prefilled.index] = true;
+        nPrefilled++;
+    }
+
+    // The short ids fill the remaining slots in order
+    boost::unordered_map<uint64_t, uint32_t> mapShortIDs;
+    size_t nShortID = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vAvailable[i])
+            continue;
+        // Two transactions of the block share a short id, only the full block can tell them apart
+        if (!mapShortIDs.insert(std::make_pair(cmpctblock.shorttxids[nShortID++], i)).second)
+            return READ_STATUS_FAILED;
+    }
+
+    {
+        LOCK(pool.cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+            boost::unordered_map<uint64_t, uint32_t>::iterator itShortID = mapShortIDs.find(cmpctblock.GetShortID(it->first));
+            if (itShortID == mapShortIDs.end())
+                continue;
+
+            uint32_t nIndex = itShortID->second;
+            if (vAvailable[nIndex]) {
+                // Two mempool transactions match, request the slot instead of guessing
+                vtx[nIndex] = CTransaction();
+                vAvailable[nIndex] = false;
+                nFromMempool--;
+                mapShortIDs.erase(itShortID);
+                continue;
+            }
+            vtx[nIndex] = it->second.GetTx();
+            vAvailable[nIndex] = true;
+            nFromMempool++;
+            // A collision with a later mempool transaction shows up as a merkle root mismatch in FillBlock
+            if (nFromMempool == cmpctblock.shorttxids.size())
+                break;
+        }
+    }
+
+    LogPrint("net", "Initialized compact block %s: %u prefilled, %u from mempool, %u missing\n",
+        header.GetHash().ToString(), nPrefilled, nFromMempool, vtx.size() - nPrefilled - nFromMempool);
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(!header.IsNull());
+    assert(index < vAvailable.size());
+    return vAvailable[index];
+}
+
+void PartiallyDownloadedBlock::GetMissing(std::vector<uint32_t>& vIndexesOut) const
+{
+    vIndexesOut.clear();
+    for (size_t i = 0; i < vAvailable.size(); i++) {
+        if (!vAvailable[i])
+            vIndexesOut.push_back(i);
+    }
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing)
+{
+    assert(!header.IsNull());
+    block = CBlock(header);
+    block.vchBlockSig.swap(vchBlockSig);
+    block.vtx.swap(vtx);
+
+    size_t nMissing = 0;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        if (vAvailable[i])
+            continue;
+        if (nMissing >= vtxMissing.size())
+            return READ_STATUS_INVALID;
+        block.vtx[i] = vtxMissing[nMissing++];
+    }
+
+    header.SetNull();
+    vAvailable.clear();
+
+    if (nMissing != vtxMissing.size())
+        return READ_STATUS_INVALID;
+
+    // A short id collision puts the wrong transaction in the block, which only the merkle root tells
+    bool fMutated = false;
+    if (block.BuildMerkleTree(&fMutated) != block.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+
+    return READ_STATUS_OK;
+}
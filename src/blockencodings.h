@@ -0,0 +1,201 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+
+#include <ios>
+#include <stdint.h>
+#include <vector>
+
+class CTxMemPool;
+
+//! Compact block encoding negotiated with sendcmpct
+static const uint64_t COMPACT_BLOCKS_ENCODING_VERSION = 1;
+//! Blocks deeper than this below the tip are sent in full when asked for as compact blocks
+static const int MAX_CMPCTBLOCK_DEPTH = 10;
+//! getblocktxn is only answered for blocks this close to the tip, older blocks are sent in full
+static const int MAX_BLOCKTXN_DEPTH = 15;
+
+/** Transactions missing to complete a compact block, by their index in the block */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint32_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(indexes);
+    }
+};
+
+/** Reply to a BlockTransactionsRequest, the transactions in the order they were requested */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent in full within a compact block */
+struct PrefilledTransaction {
+    uint32_t index;
+    CTransaction tx;
+
+    PrefilledTransaction() : index(0) {}
+    PrefilledTransaction(uint32_t indexIn, const CTransaction& txIn) : index(indexIn), tx(txIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(index);
+        READWRITE(tx);
+    }
+};
+
+/** Serializes a vector of short transaction ids in 6 bytes each */
+class CShortTxIDs
+{
+private:
+    std::vector<uint64_t>& vShortIDs;
+
+public:
+    static const unsigned int SHORTTXIDS_LENGTH = 6;
+
+    explicit CShortTxIDs(std::vector<uint64_t>& vShortIDsIn) : vShortIDs(vShortIDsIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(vShortIDs.size()) + vShortIDs.size() * SHORTTXIDS_LENGTH;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, vShortIDs.size());
+        for (size_t i = 0; i < vShortIDs.size(); i++) {
+            uint32_t lsb = vShortIDs[i] & 0xffffffff;
+            uint16_t msb = (vShortIDs[i] >> 32) & 0xffff;
+            ::Serialize(s, lsb, nType, nVersion);
+            ::Serialize(s, msb, nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        uint64_t nCount = ReadCompactSize(s);
+        if (nCount > MAX_BLOCK_SIZE_CURRENT / SHORTTXIDS_LENGTH)
+            throw std::ios_base::failure("compact block short ids exceed the maximum block size");
+        vShortIDs.resize(nCount);
+        for (size_t i = 0; i < vShortIDs.size(); i++) {
+            uint32_t lsb;
+            uint16_t msb;
+            ::Unserialize(s, lsb, nType, nVersion);
+            ::Unserialize(s, msb, nType, nVersion);
+            vShortIDs[i] = (uint64_t(msb) << 32) | uint64_t(lsb);
+        }
+    }
+};
+
+/**
+ * A block as its header and signature, the transactions a mempool cannot have
+ * (the coinbase, and the coinstake of proof-of-stake blocks), and 6 byte short
+ * ids of all the other transactions. Short ids are SipHash-2-4 of the txid,
+ * keyed by the header and a nonce chosen by the sender, so that collisions
+ * cannot be planned across blocks.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+    CBlockHeaderAndShortTxIDs() : shorttxidk0(0), shorttxidk1(0), nonce(0) {}
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(header);
+        READWRITE(nonce);
+
+        READWRITE(REF(CShortTxIDs(shorttxids)));
+        READWRITE(prefilledtxn);
+        READWRITE(vchBlockSig);
+
+        if (ser_action.ForRead())
+            FillShortTxIDSelector();
+    }
+};
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //!< the data is malformed, the peer sent it knowingly
+    READ_STATUS_FAILED,  //!< the block could not be rebuilt, e.g. on a short id collision, fetch it in full
+};
+
+/**
+ * A block being rebuilt from a compact block: the prefilled transactions and
+ * those found in the mempool, until the rest arrive in a blocktxn message.
+ */
+class PartiallyDownloadedBlock
+{
+private:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vAvailable;
+    size_t nPrefilled;
+    size_t nFromMempool;
+
+public:
+    PartiallyDownloadedBlock() : nPrefilled(0), nFromMempool(0) {}
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool);
+    bool IsTxAvailable(size_t index) const;
+    //! Indexes of the transactions to request with getblocktxn
+    void GetMissing(std::vector<uint32_t>& vIndexesOut) const;
+    //! Complete the block with the missing transactions in index order, this consumes the partial block
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing);
+
+    uint256 GetBlockHash() const { return header.GetHash(); }
+    size_t GetPrefilledCount() const { return nPrefilled; }
+    size_t GetMempoolCount() const { return nFromMempool; }
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
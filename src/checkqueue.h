@@ -6,6 +6,7 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -16,6 +17,94 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Interface through which a CCheckQueueHost's workers process a queue's checks */
+class CCheckQueueBase
+{
+public:
+    virtual ~CCheckQueueBase() {}
+
+    //! Process one batch of checks, or unregister from the host if there are none
+    virtual void Work() = 0;
+};
+
+/**
+ * Pool of worker threads shared by several check queues, so that each kind
+ * of verification does not need its own set of threads. Queues with checks
+ * left are served in turn, one batch at a time. Their masters still process
+ * checks themselves while waiting, so a queue never depends on the workers
+ * being free.
+ */
+class CCheckQueueHost
+{
+private:
+    //! Mutex to protect the inner state, taken after a queue's own mutex
+    boost::mutex mutex;
+
+    //! Worker threads block on this when no queue has checks
+    boost::condition_variable condWorker;
+
+    //! Queues that may have checks left, in the order they are served
+    std::deque<CCheckQueueBase*> queues;
+
+    //! The number of worker threads.
+    int nThreads;
+
+public:
+    CCheckQueueHost() : nThreads(0) {}
+
+    //! Worker thread
+    void Thread()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nThreads++;
+        }
+        try {
+            while (true) {
+                CCheckQueueBase* pqueue;
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (queues.empty())
+                        condWorker.wait(lock);
+                    // Rotate, so that the next worker picks another queue
+                    pqueue = queues.front();
+                    queues.pop_front();
+                    queues.push_back(pqueue);
+                }
+                pqueue->Work();
+            }
+        } catch (...) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nThreads--;
+            throw;
+        }
+    }
+
+    //! Called by a queue, with its mutex held, when it gets checks
+    void Register(CCheckQueueBase* pqueue, unsigned int nChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queues.push_back(pqueue);
+        if (nChecks == 1)
+            condWorker.notify_one();
+        else
+            condWorker.notify_all();
+    }
+
+    //! Called by a queue, with its mutex held, when it has no checks left
+    void Unregister(CCheckQueueBase* pqueue)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queues.erase(std::remove(queues.begin(), queues.end(), pqueue), queues.end());
+    }
+
+    int GetThreads()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return nThreads;
+    }
+};
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,9 +114,12 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * The worker threads are either the queue's own, running Thread(), or
+  * those of a CCheckQueueHost shared with other queues.
   */
 template <typename T>
-class CCheckQueue
+class CCheckQueue : public CCheckQueueBase
 {
 private:
     //! Mutex to protect the inner state
@@ -65,6 +157,12 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The shared worker pool, if any
+    CCheckQueueHost* phost;
+
+    //! Whether the queue is registered with phost
+    bool fRegistered;
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
@@ -127,8 +225,40 @@ private:
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue, served by phostIn's workers if given
+    CCheckQueue(unsigned int nBatchSizeIn, CCheckQueueHost* phostIn = NULL) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn), phost(phostIn), fRegistered(false) {}
+
+    //! Process one batch on a worker of phost, like an iteration of Loop()
+    void Work()
+    {
+        std::vector<T> vChecks;
+        bool fOk;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (queue.empty()) {
+                fRegistered = false;
+                phost->Unregister(this);
+                return;
+            }
+            unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + phost->GetThreads() + 1)));
+            vChecks.resize(nNow);
+            for (unsigned int i = 0; i < nNow; i++) {
+                vChecks[i].swap(queue.back());
+                queue.pop_back();
+            }
+            fOk = fAllOk;
+        }
+        BOOST_FOREACH (T& check, vChecks)
+            if (fOk)
+                fOk = check();
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fAllOk &= fOk;
+            nTodo -= vChecks.size();
+            if (nTodo == 0)
+                condMaster.notify_one();
+        }
+    }
 
     //! Worker thread
     void Thread()
@@ -151,7 +281,12 @@ public:
             check.swap(queue.back());
         }
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
+        if (phost != NULL) {
+            if (!fRegistered && !queue.empty()) {
+                fRegistered = true;
+                phost->Register(this, vChecks.size());
+            }
+        } else if (vChecks.size() == 1)
             condWorker.notify_one();
         else if (vChecks.size() > 1)
             condWorker.notify_all();
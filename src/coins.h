@@ -7,6 +7,8 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "flatmap.h"
+#include "memusage.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -16,7 +18,6 @@
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
-#include <boost/unordered_map.hpp>
 
 /** 
 
@@ -283,6 +284,16 @@ public:
                 return false;
         return true;
     }
+
+    size_t DynamicMemoryUsage() const
+    {
+        size_t ret = memusage::DynamicUsage(vout);
+        BOOST_FOREACH (const CTxOut& out, vout) {
+            const std::vector<unsigned char>* script = &out.scriptPubKey;
+            ret += memusage::DynamicUsage(*script);
+        }
+        return ret;
+    }
 };
 
 class CCoinsKeyHasher
@@ -293,11 +304,6 @@ private:
 public:
     CCoinsKeyHasher();
 
-    /**
-     * This *must* return size_t. With Boost 1.46 on 32-bit systems the
-     * unordered_map will behave unpredictably if the custom hasher returns a
-     * uint64_t, resulting in failures when syncing the chain (#4634).
-     */
     size_t operator()(const uint256& key) const
     {
         return key.GetHash(salt);
@@ -307,6 +313,7 @@ public:
 struct CCoinsCacheEntry {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    std::vector<bool> vModified; // Outputs whose availability changed since the entry was loaded from the parent view.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -314,9 +321,14 @@ struct CCoinsCacheEntry {
     };
 
     CCoinsCacheEntry() : coins(), flags(0) {}
+
+    size_t DynamicMemoryUsage() const
+    {
+        return coins.DynamicMemoryUsage() + memusage::DynamicUsage(vModified);
+    }
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+typedef flatmap<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
 struct CCoinsStats {
     int nHeight;
@@ -369,6 +381,7 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
+    CCoinsView* GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
 };
@@ -398,7 +411,10 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
+    size_t cachedCoinUsage; // Cached memory usage of the cache entry before modification
+    CCoins header;          // Metadata of the CCoins object before modification (without outputs)
+    std::vector<bool> vWasAvailable; // Which outputs were unspent before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -421,6 +437,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Cached dynamic memory usage for the inner CCoins objects. */
+    mutable size_t cachedCoinsUsage;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -439,6 +458,16 @@ public:
      */
     const CCoins* AccessCoins(const uint256& txid) const;
 
+    //! Check if the cache holds an entry for txid, without reading from the base view
+    bool HaveCoinsInCache(const uint256& txid) const;
+
+    /**
+     * Cache coins the caller read from the base view itself, as a cache miss
+     * would. Nothing changes if txid is already cached. coins is swapped into
+     * the cache, leaving the argument in an unspecified state.
+     */
+    void AddPrefetchedCoins(const uint256& txid, CCoins& coins);
+
     /**
      * Return a modifiable reference to a CCoins. If no entry with the given
      * txid exists, a new one is created. Simultaneous modifications are not
@@ -456,6 +485,9 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the size of the cache (in bytes)
+    size_t DynamicMemoryUsage() const;
+
     /** 
      * Amount of opcx coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -0,0 +1,326 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATMAP_H
+#define BITCOIN_FLATMAP_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iterator>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * STL-like unordered map using open addressing with linear probing.
+ *
+ * The probe table is a flat array of (hash, pointer) slots, so a lookup walks
+ * contiguous memory and only dereferences an element once the full hash
+ * matches. Elements themselves are allocated from an arena of geometrically
+ * growing chunks and never move: pointers and references to elements stay
+ * valid until the element is erased, even when the table is rehashed.
+ * Iterators are invalidated by any insertion that causes a rehash.
+ *
+ * Erasing leaves a tombstone in the table instead of shifting later slots,
+ * so erasing the element an iterator just moved past (m.erase(it++)) is safe
+ * while iterating.
+ */
+template <typename K, typename V, typename Hash>
+class flatmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef size_t size_type;
+
+private:
+    struct slot {
+        value_type* ptr; //!< NULL for empty slots and tombstones
+        size_t hash;     //!< full hash of the key, or one of the markers below when ptr is NULL
+        slot() : ptr(NULL), hash(SLOT_EMPTY) {}
+    };
+
+    enum {
+        SLOT_EMPTY = 0,
+        SLOT_TOMBSTONE = 1,
+        //! smallest table size, must be a power of two
+        MIN_TABLE_SIZE = 8,
+        //! arena chunks double in size from MIN_CHUNK_ELEMENTS up to MAX_CHUNK_ELEMENTS
+        MIN_CHUNK_ELEMENTS = 8,
+        MAX_CHUNK_ELEMENTS = 4096,
+    };
+
+    std::vector<slot> table;
+    size_t nSize;
+    size_t nTombstones;
+
+    //! arena chunks, with the number of elements each one holds
+    std::vector<std::pair<value_type*, size_t> > chunks;
+    //! next never used element of the last chunk, and the end of that chunk
+    value_type* pNext;
+    value_type* pEnd;
+    //! elements released by erase, reused before the arena grows
+    std::vector<value_type*> vFree;
+
+    Hash hasher;
+
+    flatmap(const flatmap&);
+    flatmap& operator=(const flatmap&);
+
+    size_t NextUsed(size_t pos) const
+    {
+        while (pos < table.size() && table[pos].ptr == NULL)
+            pos++;
+        return pos;
+    }
+
+    size_t Lookup(const key_type& key, size_t hash) const
+    {
+        if (table.empty())
+            return table.size();
+        const size_t mask = table.size() - 1;
+        for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+            const slot& s = table[pos];
+            if (s.ptr == NULL) {
+                if (s.hash == SLOT_EMPTY)
+                    return table.size();
+            } else if (s.hash == hash && s.ptr->first == key) {
+                return pos;
+            }
+        }
+    }
+
+    size_t FreeSlot(size_t hash) const
+    {
+        const size_t mask = table.size() - 1;
+        size_t pos = hash & mask;
+        while (table[pos].ptr != NULL)
+            pos = (pos + 1) & mask;
+        return pos;
+    }
+
+    void Rehash(size_t nNewSize)
+    {
+        std::vector<slot> old(nNewSize);
+        old.swap(table);
+        for (size_t i = 0; i < old.size(); i++) {
+            if (old[i].ptr != NULL)
+                table[FreeSlot(old[i].hash)] = old[i];
+        }
+        nTombstones = 0;
+    }
+
+    //! Make room for one more element, keeping the table at most 3/4 full (counting tombstones).
+    void Reserve()
+    {
+        if ((nSize + nTombstones + 1) * 4 <= table.size() * 3)
+            return;
+        size_t nNewSize = table.empty() ? MIN_TABLE_SIZE : table.size();
+        while ((nSize + 1) * 2 > nNewSize)
+            nNewSize *= 2;
+        Rehash(nNewSize);
+    }
+
+    value_type* Allocate()
+    {
+        if (!vFree.empty()) {
+            value_type* ptr = vFree.back();
+            vFree.pop_back();
+            return ptr;
+        }
+        if (pNext == pEnd) {
+            size_t nElements = chunks.empty() ? MIN_CHUNK_ELEMENTS : chunks.back().second * 2;
+            if (nElements > MAX_CHUNK_ELEMENTS)
+                nElements = MAX_CHUNK_ELEMENTS;
+            pNext = static_cast<value_type*>(::operator new(nElements * sizeof(value_type)));
+            pEnd = pNext + nElements;
+            chunks.push_back(std::make_pair(pNext, nElements));
+        }
+        return pNext++;
+    }
+
+    void ReleaseArena()
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+            ::operator delete(chunks[i].first);
+        std::vector<std::pair<value_type*, size_t> >().swap(chunks);
+        std::vector<value_type*>().swap(vFree);
+        pNext = pEnd = NULL;
+    }
+
+public:
+    class const_iterator;
+
+    class iterator
+    {
+        friend class flatmap;
+        friend class const_iterator;
+        flatmap* map;
+        size_t pos;
+        iterator(flatmap* mapIn, size_t posIn) : map(mapIn), pos(posIn) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flatmap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        iterator() : map(NULL), pos(0) {}
+        value_type& operator*() const { return *map->table[pos].ptr; }
+        value_type* operator->() const { return map->table[pos].ptr; }
+        iterator& operator++()
+        {
+            pos = map->NextUsed(pos + 1);
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(const iterator& other) const { return pos == other.pos && map == other.map; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+
+    class const_iterator
+    {
+        friend class flatmap;
+        const flatmap* map;
+        size_t pos;
+        const_iterator(const flatmap* mapIn, size_t posIn) : map(mapIn), pos(posIn) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef const typename flatmap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        const_iterator() : map(NULL), pos(0) {}
+        const_iterator(const iterator& it) : map(it.map), pos(it.pos) {}
+        value_type& operator*() const { return *map->table[pos].ptr; }
+        value_type* operator->() const { return map->table[pos].ptr; }
+        const_iterator& operator++()
+        {
+            pos = map->NextUsed(pos + 1);
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.pos == b.pos && a.map == b.map; }
+        friend bool operator!=(const const_iterator& a, const const_iterator& b) { return !(a == b); }
+    };
+
+    flatmap() : nSize(0), nTombstones(0), pNext(NULL), pEnd(NULL) {}
+    ~flatmap() { clear(); }
+
+    iterator begin() { return iterator(this, NextUsed(0)); }
+    iterator end() { return iterator(this, table.size()); }
+    const_iterator begin() const { return const_iterator(this, NextUsed(0)); }
+    const_iterator end() const { return const_iterator(this, table.size()); }
+
+    size_type size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const key_type& key) { return iterator(this, Lookup(key, hasher(key))); }
+    const_iterator find(const key_type& key) const { return const_iterator(this, Lookup(key, hasher(key))); }
+    size_type count(const key_type& key) const { return find(key) != end() ? 1 : 0; }
+
+    std::pair<iterator, bool> insert(const value_type& x)
+    {
+        size_t hash = hasher(x.first);
+        size_t pos = Lookup(x.first, hash);
+        if (pos != table.size())
+            return std::make_pair(iterator(this, pos), false);
+        Reserve();
+        pos = FreeSlot(hash);
+        if (table[pos].hash == SLOT_TOMBSTONE)
+            nTombstones--;
+        value_type* ptr = Allocate();
+        new (ptr) value_type(x);
+        table[pos].ptr = ptr;
+        table[pos].hash = hash;
+        nSize++;
+        return std::make_pair(iterator(this, pos), true);
+    }
+
+    mapped_type& operator[](const key_type& key)
+    {
+        return insert(value_type(key, mapped_type())).first->second;
+    }
+
+    void erase(iterator it)
+    {
+        slot& s = table[it.pos];
+        assert(s.ptr != NULL);
+        s.ptr->~value_type();
+        vFree.push_back(s.ptr);
+        s.ptr = NULL;
+        // A slot followed by an empty one is never part of a longer probe
+        // chain, so it can be emptied instead of becoming a tombstone.
+        const slot& next = table[(it.pos + 1) & (table.size() - 1)];
+        if (next.ptr == NULL && next.hash == SLOT_EMPTY) {
+            s.hash = SLOT_EMPTY;
+        } else {
+            s.hash = SLOT_TOMBSTONE;
+            nTombstones++;
+        }
+        nSize--;
+    }
+
+    size_type erase(const key_type& key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < table.size(); i++) {
+            if (table[i].ptr != NULL)
+                table[i].ptr->~value_type();
+        }
+        std::vector<slot>().swap(table);
+        ReleaseArena();
+        nSize = 0;
+        nTombstones = 0;
+    }
+
+    void swap(flatmap& other)
+    {
+        table.swap(other.table);
+        std::swap(nSize, other.nSize);
+        std::swap(nTombstones, other.nTombstones);
+        chunks.swap(other.chunks);
+        std::swap(pNext, other.pNext);
+        std::swap(pEnd, other.pEnd);
+        vFree.swap(other.vFree);
+        std::swap(hasher, other.hasher);
+    }
+
+    //! Heap memory owned by the map itself: probe table, arena and free list (not the elements' own allocations)
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = memusage::DynamicUsage(table) + memusage::DynamicUsage(chunks) + memusage::DynamicUsage(vFree);
+        for (size_t i = 0; i < chunks.size(); i++)
+            nUsage += memusage::MallocUsage(chunks[i].second * sizeof(value_type));
+        return nUsage;
+    }
+};
+
+#endif // BITCOIN_FLATMAP_H
@@ -5,9 +5,14 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <atomic>
+#include <limits>
+
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "checkqueue.h"
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -20,20 +25,6 @@ using namespace std;
 static std::map<int, unsigned int> mapStakeModifierCheckpoints =
     boost::assign::map_list_of(0, 0xfd11f4e7u);
 
-// Get the last stake modifier and its generation time from a given block
-static bool GetLastStakeModifier(const CBlockIndex* pindex, uint64_t& nStakeModifier, int64_t& nModifierTime)
-{
-    if (!pindex)
-        return error("GetLastStakeModifier: null pindex");
-    while (pindex && pindex->pprev && !pindex->GeneratedStakeModifier())
-        pindex = pindex->pprev;
-    if (!pindex->GeneratedStakeModifier())
-        return error("GetLastStakeModifier: no generation at genesis block");
-    nStakeModifier = pindex->nStakeModifier;
-    nModifierTime = pindex->GetBlockTime();
-    return true;
-}
-
 // Get selection interval section (in seconds)
 static int64_t GetStakeModifierSelectionIntervalSection(int nSection)
 {
@@ -52,6 +43,117 @@ static int64_t GetStakeModifierSelectionInterval()
     return nSelectionInterval;
 }
 
+void CStakeModifierIndex::Connect(const CBlockIndex* pindex)
+{
+    const int nHeight = vEntries.size();
+    Entry entry;
+    entry.pindex = pindex;
+    entry.nTime = pindex->nTime;
+    entry.nModifierHeight = -1;
+    entry.nPendingFloor = setPending.empty() ? nHeight : *setPending.begin();
+    if (pindex->GeneratedStakeModifier()) {
+        entry.nLastModifierHeight = nHeight;
+        for (std::set<int>::iterator it = setPending.begin(); it != setPending.end();) {
+            if ((int64_t)vEntries[*it].nTime + nSelectionInterval <= pindex->GetBlockTime()) {
+                vEntries[*it].nModifierHeight = nHeight;
+                setPending.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    } else {
+        entry.nLastModifierHeight = vEntries.empty() ? -1 : vEntries.back().nLastModifierHeight;
+    }
+    vEntries.push_back(entry);
+    setPending.insert(nHeight);
+}
+
+void CStakeModifierIndex::Disconnect()
+{
+    // Every height the tip resolved was pending when it was added
+    const int nHeight = vEntries.size() - 1;
+    for (int i = vEntries.back().nPendingFloor; i < nHeight; i++) {
+        if (vEntries[i].nModifierHeight == nHeight) {
+            vEntries[i].nModifierHeight = -1;
+            setPending.insert(i);
+        }
+    }
+    setPending.erase(nHeight);
+    vEntries.pop_back();
+}
+
+void CStakeModifierIndex::Sync(const CChain& chain)
+{
+    while (!vEntries.empty() && chain[vEntries.size() - 1] != vEntries.back().pindex)
+        Disconnect();
+    for (int nHeight = vEntries.size(); nHeight <= chain.Height(); nHeight++)
+        Connect(chain[nHeight]);
+}
+
+void CStakeModifierIndex::Clear()
+{
+    std::vector<Entry>().swap(vEntries);
+    setPending.clear();
+}
+
+const CBlockIndex* CStakeModifierIndex::GetKernelModifierBlock(const CBlockIndex* pindexFrom) const
+{
+    const int nHeight = pindexFrom->nHeight;
+    if (nHeight >= (int)vEntries.size() || vEntries[nHeight].pindex != pindexFrom || vEntries[nHeight].nModifierHeight < 0)
+        return NULL;
+    return vEntries[vEntries[nHeight].nModifierHeight].pindex;
+}
+
+const CBlockIndex* CStakeModifierIndex::GetLastModifierBlock(const CBlockIndex* pindex) const
+{
+    const int nHeight = pindex->nHeight;
+    if (nHeight >= (int)vEntries.size() || vEntries[nHeight].pindex != pindex || vEntries[nHeight].nLastModifierHeight < 0)
+        return NULL;
+    return vEntries[vEntries[nHeight].nLastModifierHeight].pindex;
+}
+
+// Index of chainActive, guarded by cs_main
+static CStakeModifierIndex& GetStakeModifierIndex()
+{
+    static CStakeModifierIndex stakeModifierIndex(GetStakeModifierSelectionInterval());
+    return stakeModifierIndex;
+}
+
+void SyncStakeModifierIndex()
+{
+    LOCK(cs_main);
+    GetStakeModifierIndex().Sync(chainActive);
+}
+
+void ResetStakeModifierIndex()
+{
+    LOCK(cs_main);
+    GetStakeModifierIndex().Clear();
+}
+
+// Get the last stake modifier and its generation time from a given block
+static bool GetLastStakeModifier(const CBlockIndex* pindex, uint64_t& nStakeModifier, int64_t& nModifierTime)
+{
+    if (!pindex)
+        return error("GetLastStakeModifier: null pindex");
+    {
+        LOCK(cs_main);
+        GetStakeModifierIndex().Sync(chainActive);
+        const CBlockIndex* pindexLast = GetStakeModifierIndex().GetLastModifierBlock(pindex);
+        if (pindexLast)
+            pindex = pindexLast;
+    }
+    // Blocks off the active chain are walked back
+    while (pindex && pindex->pprev && !pindex->GeneratedStakeModifier())
+        pindex = pindex->pprev;
+    if (!pindex->GeneratedStakeModifier())
+        return error("GetLastStakeModifier: no generation at genesis block");
+    nStakeModifier = pindex->nStakeModifier;
+    nModifierTime = pindex->GetBlockTime();
+    return true;
+}
+
+
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
 // already selected blocks in vSelectedBlocks, and with timestamp up to
 // nSelectionIntervalStop.
@@ -231,6 +333,19 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
     if (!mapBlockIndex.count(hashBlockFrom))
         return error("GetKernelStakeModifier() : block not indexed");
     const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
+    {
+        LOCK(cs_main);
+        GetStakeModifierIndex().Sync(chainActive);
+        const CBlockIndex* pindex = GetStakeModifierIndex().GetKernelModifierBlock(pindexFrom);
+        if (pindex) {
+            nStakeModifier = pindex->nStakeModifier;
+            nStakeModifierHeight = pindex->nHeight;
+            nStakeModifierTime = pindex->GetBlockTime();
+            return true;
+        }
+    }
+
+    // Not in the active chain, or no modifier late enough yet: walk chainActive
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
@@ -273,7 +388,35 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
 }
 
 //instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
+CStakeKernel::CStakeKernel(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout, int64_t nValueIn, unsigned int nBits)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << prevout.n << prevout.hash;
+    hasherPrefix.Write((const unsigned char*)&ss[0], ss.size());
+
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    bnTarget = (uint256(nValueIn) / 10000) * bnTargetPerCoinDay;
+}
+
+uint256 CStakeKernel::GetHash(unsigned int nTimeTx) const
+{
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    WriteLE32(buf, nTimeTx);
+    CSHA256 hasher(hasherPrefix);
+    hasher.Write(buf, 4).Finalize(buf);
+    uint256 hash;
+    CSHA256().Write(buf, sizeof(buf)).Finalize((unsigned char*)&hash);
+    return hash;
+}
+
+bool CStakeKernel::CheckHash(unsigned int nTimeTx, uint256& hashProofOfStake) const
+{
+    hashProofOfStake = GetHash(nTimeTx);
+    return hashProofOfStake < bnTarget;
+}
+
+bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
 {
     //assign new variables to make it easier to read
     int64_t nValueIn = txPrev.vout[prevout.n].nValue;
@@ -293,10 +436,6 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
         }
     }
 
-    //grab difficulty
-    uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-
     //grab stake modifier
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
@@ -306,15 +445,12 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
         return false;
     }
 
-    //create data stream once instead of repeating it in the loop
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier;
+    //serialize the constant part of the kernel once instead of repeating it in the loop
+    const CStakeKernel kernel(nStakeModifier, nTimeBlockFrom, prevout, nValueIn, nBits);
 
     //if wallet is simply checking to make sure a hash is valid
-    if (fCheck) {
-        hashProofOfStake = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
-        return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
-    }
+    if (fCheck)
+        return kernel.CheckHash(nTimeTx, hashProofOfStake);
 
     bool fSuccess = false;
     unsigned int nTryTime = 0;
@@ -328,10 +464,8 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
 
         //hash this iteration
         nTryTime = nTimeTx + nHashDrift - i;
-        hashProofOfStake = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
-
         // if stake hash does not meet the target then continue to next iteration
-        if (!stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay))
+        if (!kernel.CheckHash(nTryTime, hashProofOfStake))
             continue;
 
         fSuccess = true; // if we make it this far then we have successfully created a stake hash
@@ -362,6 +496,161 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+/** State shared by the checks of one FindStakeKernel call */
+struct CStakeSearch {
+    unsigned int nTimeStart;
+    unsigned int nHashDrift;
+    unsigned int nMinTime;
+    int nHeightStart;
+    //! index of the earliest kernel with a hit so far; later kernels stop searching
+    std::atomic<unsigned int> nBest;
+    std::atomic<uint64_t> nHashes;
+    //! per kernel, the timestamp (0 if none) and hash of its hit
+    std::vector<std::pair<unsigned int, uint256> > vHits;
+
+    CStakeSearch(unsigned int nTimeStartIn, unsigned int nHashDriftIn, unsigned int nMinTimeIn) : nTimeStart(nTimeStartIn), nHashDrift(nHashDriftIn), nMinTime(nMinTimeIn), nHeightStart(0), nBest(std::numeric_limits<unsigned int>::max()), nHashes(0) {}
+};
+
+/** Closure sweeping the timestamps of one stake kernel, so that candidates are searched in parallel */
+class CStakeKernelCheck
+{
+private:
+    const CStakeKernel* kernel;
+    unsigned int nIndex;
+    CStakeSearch* search;
+
+public:
+    CStakeKernelCheck() : kernel(NULL), nIndex(0), search(NULL) {}
+    CStakeKernelCheck(const CStakeKernel* kernelIn, unsigned int nIndexIn, CStakeSearch* searchIn) : kernel(kernelIn), nIndex(nIndexIn), search(searchIn) {}
+
+    bool operator()()
+    {
+        //new block came in, move on
+        if (chainActive.Height() != search->nHeightStart)
+            return true;
+
+        uint64_t nHashes = 0;
+        for (unsigned int i = 0; i < search->nHashDrift; i++) {
+            if (nIndex > search->nBest.load(std::memory_order_relaxed))
+                break;
+            unsigned int nTryTime = search->nTimeStart + search->nHashDrift - i;
+            if (nTryTime <= search->nMinTime)
+                break;
+            nHashes++;
+            uint256 hashProofOfStake;
+            if (kernel->CheckHash(nTryTime, hashProofOfStake)) {
+                search->vHits[nIndex] = std::make_pair(nTryTime, hashProofOfStake);
+                unsigned int nBest = search->nBest.load();
+                while (nIndex < nBest && !search->nBest.compare_exchange_weak(nBest, nIndex)) {
+                }
+                break;
+            }
+        }
+        search->nHashes += nHashes;
+        return true;
+    }
+
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(kernel, check.kernel);
+        std::swap(nIndex, check.nIndex);
+        std::swap(search, check.search);
+    }
+};
+
+static CCheckQueue<CStakeKernelCheck> stakesearchqueue(16, &checkqueuehost);
+/** Only one master may drive the stake search queue at a time */
+static CCriticalSection cs_stakesearchqueue;
+
+static CCriticalSection cs_stakesearchstats;
+static CStakeSearchStats stakeSearchStats;
+
+int FindStakeKernel(unsigned int nBits, const std::vector<CStakeCandidate>& vCandidates, unsigned int nTimeStart, unsigned int nHashDrift, unsigned int nMinTime, unsigned int& nTimeTx, uint256& hashProofOfStake)
+{
+    int64_t nSearchStart = GetTimeMicros();
+    CStakeSearch search(nTimeStart, nHashDrift, nMinTime);
+    std::vector<CStakeKernel> vKernels;
+    std::vector<unsigned int> vCandidateIndex;
+    vKernels.reserve(vCandidates.size());
+    vCandidateIndex.reserve(vCandidates.size());
+    {
+        LOCK(cs_main);
+        search.nHeightStart = chainActive.Height();
+        const int64_t nMinStakeAge = Params().GetMinStakeAge(chainActive.Height() + 1);
+        //coins from the same block share their stake modifier
+        std::map<uint256, uint64_t> mapModifiers;
+        for (unsigned int i = 0; i < vCandidates.size(); i++) {
+            const CStakeCandidate& candidate = vCandidates[i];
+            BlockMap::const_iterator mi = mapBlockIndex.find(candidate.hashBlockFrom);
+            if (mi == mapBlockIndex.end())
+                continue;
+            unsigned int nTimeBlockFrom = mi->second->GetBlockTime();
+            if (nTimeStart < nTimeBlockFrom || nTimeBlockFrom + nMinStakeAge > nTimeStart)
+                continue;
+
+            std::map<uint256, uint64_t>::const_iterator itModifier = mapModifiers.find(candidate.hashBlockFrom);
+            if (itModifier == mapModifiers.end()) {
+                uint64_t nStakeModifier = 0;
+                int nStakeModifierHeight = 0;
+                int64_t nStakeModifierTime = 0;
+                if (!GetKernelStakeModifier(candidate.hashBlockFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false)) {
+                    LogPrintf("FindStakeKernel(): failed to get kernel stake modifier\n");
+                    continue;
+                }
+                itModifier = mapModifiers.insert(std::make_pair(candidate.hashBlockFrom, nStakeModifier)).first;
+            }
+            vKernels.push_back(CStakeKernel(itModifier->second, nTimeBlockFrom, candidate.prevout, candidate.nValue, nBits));
+            vCandidateIndex.push_back(i);
+        }
+    }
+
+    search.vHits.resize(vKernels.size());
+    // The queue hands out the most recently added checks first, so add the
+    // preferred candidates last
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve(vKernels.size());
+    for (unsigned int i = vKernels.size(); i-- > 0;)
+        vChecks.push_back(CStakeKernelCheck(&vKernels[i], i, &search));
+    {
+        // Without -par workers the master runs the checks alone, in the same order
+        LOCK(cs_stakesearchqueue);
+        CCheckQueueControl<CStakeKernelCheck> control(&stakesearchqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    int nResult = -1;
+    {
+        LOCK(cs_main);
+        unsigned int nBest = search.nBest;
+        if (nBest < vKernels.size() && chainActive.Height() == search.nHeightStart) {
+            nTimeTx = search.vHits[nBest].first;
+            hashProofOfStake = search.vHits[nBest].second;
+            nResult = vCandidateIndex[nBest];
+        }
+
+        mapHashedBlocks.clear();
+        CBlockIndex* pindex = chainActive.Tip();
+        if (pindex)
+            mapHashedBlocks[pindex->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    }
+
+    {
+        LOCK(cs_stakesearchstats);
+        stakeSearchStats.nCandidates = vKernels.size();
+        stakeSearchStats.nHashes = search.nHashes;
+        stakeSearchStats.nTime = GetTime();
+        stakeSearchStats.nDuration = GetTimeMicros() - nSearchStart;
+    }
+    return nResult;
+}
+
+void GetStakeSearchStats(CStakeSearchStats& stats)
+{
+    LOCK(cs_stakesearchstats);
+    stats = stakeSearchStats;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
 {
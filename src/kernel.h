@@ -5,16 +5,117 @@
 #ifndef BITCOIN_KERNEL_H
 #define BITCOIN_KERNEL_H
 
+#include "crypto/sha256.h"
 #include "main.h"
 
+#include <set>
+#include <vector>
+
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
+/**
+ * Per height index of a chain answering the stake modifier lookups without
+ * walking it: for every block, the block whose modifier kernels with that
+ * block-from hash with (the first block generating a modifier a selection
+ * interval after it), and the last block up to it that generated a modifier.
+ *
+ * Sync follows the chain from where the index stands, so advancing the tip
+ * costs one step per block and a reorg unwinds only the disconnected blocks.
+ * Blocks still waiting for their kernel modifier are kept in a pending set
+ * and resolved as modifier generating blocks are added.
+ */
+class CStakeModifierIndex
+{
+private:
+    struct Entry {
+        const CBlockIndex* pindex;
+        unsigned int nTime;
+        int nModifierHeight;     //!< -1 while no block resolves it yet
+        int nLastModifierHeight; //!< -1 if no block up to here generated a modifier
+        int nPendingFloor;       //!< lowest pending height when this block was added
+    };
+
+    const int64_t nSelectionInterval;
+    std::vector<Entry> vEntries;
+    std::set<int> setPending;
+
+    void Connect(const CBlockIndex* pindex);
+    void Disconnect();
+
+public:
+    CStakeModifierIndex(int64_t nSelectionIntervalIn) : nSelectionInterval(nSelectionIntervalIn) {}
+
+    void Sync(const CChain& chain);
+    void Clear();
+
+    //! Block whose modifier a kernel from pindexFrom uses, NULL if not indexed or not resolved yet
+    const CBlockIndex* GetKernelModifierBlock(const CBlockIndex* pindexFrom) const;
+    //! Last block up to pindex that generated a modifier, NULL if not indexed
+    const CBlockIndex* GetLastModifierBlock(const CBlockIndex* pindex) const;
+};
+
+/** Bring the stake modifier index of chainActive up to date with its tip */
+void SyncStakeModifierIndex();
+void ResetStakeModifierIndex();
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
+/**
+ * The kernel hash of one stake candidate, with everything but the timestamp
+ * prepared once. The modifier, block-from time and prevout are already
+ * written to a SHA256 hasher, and the coin's weighted target is computed up
+ * front, so one attempt costs a hasher copy and two compressions.
+ */
+class CStakeKernel
+{
+private:
+    CSHA256 hasherPrefix;
+    uint256 bnTarget; //!< coin day weight times target per coin day
+
+public:
+    CStakeKernel() {}
+    CStakeKernel(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout, int64_t nValueIn, unsigned int nBits);
+
+    //! Same as stakeHash() for this kernel
+    uint256 GetHash(unsigned int nTimeTx) const;
+    //! Same as stakeTargetHit() for the hash of this kernel at nTimeTx
+    bool CheckHash(unsigned int nTimeTx, uint256& hashProofOfStake) const;
+};
+
+/** A coin the wallet may stake */
+struct CStakeCandidate {
+    COutPoint prevout;
+    int64_t nValue;
+    uint256 hashBlockFrom; //!< block containing the coin
+
+    CStakeCandidate(const COutPoint& prevoutIn, int64_t nValueIn, const uint256& hashBlockFromIn) : prevout(prevoutIn), nValue(nValueIn), hashBlockFrom(hashBlockFromIn) {}
+};
+
+/**
+ * Search the timestamps in (nTimeStart, nTimeStart + nHashDrift] for a kernel
+ * of any of vCandidates, on the stake search threads. Timestamps up to
+ * nMinTime are skipped. Like a serial walk with CheckStakeKernelHash, the
+ * earliest candidate with a hit wins, and each candidate prefers its latest
+ * timestamp. Returns the index of the winning candidate, or -1.
+ */
+int FindStakeKernel(unsigned int nBits, const std::vector<CStakeCandidate>& vCandidates, unsigned int nTimeStart, unsigned int nHashDrift, unsigned int nMinTime, unsigned int& nTimeTx, uint256& hashProofOfStake);
+
+struct CStakeSearchStats {
+    unsigned int nCandidates;
+    uint64_t nHashes;
+    int64_t nDuration; //!< in microseconds
+    int64_t nTime;     //!< when the search ended
+
+    CStakeSearchStats() : nCandidates(0), nHashes(0), nDuration(0), nTime(0) {}
+};
+
+//! Statistics of the last FindStakeKernel call
+void GetStakeSearchStats(CStakeSearchStats& stats);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
@@ -31,8 +31,14 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    size_t nSize;
 
 public:
+    CLevelDBBatch() : nSize(0) {}
+
+    //! Total size of the keys and values queued so far
+    size_t SizeEstimate() const { return nSize; }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +53,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        nSize += ssKey.size() + ssValue.size();
     }
 
     template <typename K>
@@ -58,6 +65,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        nSize += ssKey.size();
     }
 };
 
@@ -164,9 +172,10 @@ public:
     }
 
     // not exactly clean encapsulation, but it's easiest for now
-    leveldb::Iterator* NewIterator()
+    //! fFillCache: keep the blocks read in the block cache, for point lookups rather than full scans
+    leveldb::Iterator* NewIterator(bool fFillCache = false)
     {
-        return pdb->NewIterator(iteroptions);
+        return pdb->NewIterator(fFillCache ? readoptions : iteroptions);
     }
 };
 
@@ -116,14 +116,30 @@ bool AccumulatorProofOfKnowledge:: Verify(const Accumulator& a, const CBigNum& v
 
 	CBigNum c = CBigNum(hasher.GetHash()); //this hash should be of length k_prime bits
 
-	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sg.pow_mod(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_2_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * ((valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_3_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-
-	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_zeta, params->accumulatorModulus) * g_n.pow_mod(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_eta, params->accumulatorModulus) * g_n.pow_mod(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_3_prime = ((a.getValue()).pow_mod(c, params->accumulatorModulus) * C_u.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	// sg, sh and g_n, h_n are the fixed bases of the two groups, (g^-1)^x is computed as g^-x
+	const GroupArithmetic& arithPoK = params->accumulatorPoKCommitmentGroup.arithmetic();
+	const GroupArithmetic& arithQRN = params->accumulatorQRNCommitmentGroup.arithmetic();
+
+	// each commitment is checked with one multi-exponentiation, products of two variable bases share their squarings
+	const CBigNum& pokModulus = params->accumulatorPoKCommitmentGroup.modulus;
+	std::vector<CBigNum> vBases(1), vExps(1);
+
+	vBases[0] = valueOfCommitmentToCoin; vExps[0] = c;
+	CBigNum st_1_prime = arithPoK.multiExp(vBases, vExps, s_alpha, s_phi);
+	vBases[0] = valueOfCommitmentToCoin.mul_mod(sg.inverse(pokModulus), pokModulus); vExps[0] = s_gamma;
+	CBigNum st_2_prime = arithPoK.multiExp(vBases, vExps, c, s_psi);
+	vBases[0] = sg.mul_mod(valueOfCommitmentToCoin, pokModulus); vExps[0] = s_sigma;
+	CBigNum st_3_prime = arithPoK.multiExp(vBases, vExps, c, s_xi);
+
+	vBases[0] = C_r; vExps[0] = c;
+	CBigNum t_1_prime = arithQRN.multiExp(vBases, vExps, s_epsilon, s_zeta);
+	vBases[0] = C_e; vExps[0] = c;
+	CBigNum t_2_prime = arithQRN.multiExp(vBases, vExps, s_alpha, s_eta);
+	vBases[0] = a.getValue(); vExps[0] = c;
+	vBases.push_back(C_u); vExps.push_back(s_alpha);
+	CBigNum t_3_prime = arithQRN.multiExp(vBases, vExps, CBigNum(0), s_beta * -1);
+	vBases.assign(1, C_r); vExps.assign(1, s_alpha);
+	CBigNum t_4_prime = arithQRN.multiExp(vBases, vExps, s_beta * -1, s_delta * -1);
 
 	bool result = false;
 
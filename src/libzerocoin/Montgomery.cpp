@@ -0,0 +1,462 @@
+/**
+ * @file       Montgomery.cpp
+ *
+ * @brief      Fixed width Montgomery arithmetic for the Zerocoin library.
+ *
+ * @copyright  Copyright 2018 The OPCX developers
+ * @license    This project is released under the MIT license.
+ **/
+
+#include "Montgomery.h"
+
+#include <algorithm>
+#include <string.h>
+#include <utility>
+
+namespace libzerocoin {
+
+static const unsigned int MONT_LIMB_BYTES = sizeof(mont_limb_t);
+
+//! Load a non-negative x < 2^(MONT_LIMB_BITS * nLimbs) into limbs
+static void LoadLimbs(const CBigNum& x, mont_limb_t* r, unsigned int nLimbs)
+{
+    std::vector<unsigned char> vch = x.getvch();
+    memset(r, 0, nLimbs * MONT_LIMB_BYTES);
+    for (unsigned int i = 0; i < vch.size() && i < nLimbs * MONT_LIMB_BYTES; i++)
+        r[i / MONT_LIMB_BYTES] |= (mont_limb_t)vch[i] << (8 * (i % MONT_LIMB_BYTES));
+}
+
+static CBigNum StoreLimbs(const mont_limb_t* a, unsigned int nLimbs)
+{
+    // little endian magnitude, with a zero top byte so it is never read as negative
+    std::vector<unsigned char> vch(nLimbs * MONT_LIMB_BYTES + 1, 0);
+    for (unsigned int i = 0; i < nLimbs * MONT_LIMB_BYTES; i++)
+        vch[i] = (unsigned char)(a[i / MONT_LIMB_BYTES] >> (8 * (i % MONT_LIMB_BYTES)));
+    return CBigNum(vch);
+}
+
+//! Product of vBases[i]^vExps[i] mod m, exponentiating the bases two at a time
+static CBigNum MultiExpPairwise(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNum& m)
+{
+    // pair up exponents of similar width, a pair costs the squarings of its wider exponent
+    std::vector<std::pair<int, size_t> > vOrder;
+    for (size_t i = 0; i < vExps.size(); i++) {
+        if (vExps[i] != CBigNum(0))
+            vOrder.push_back(std::make_pair(vExps[i].bitSize(), i));
+    }
+    std::sort(vOrder.rbegin(), vOrder.rend());
+
+    CBigNum result = CBigNum(1);
+    for (size_t k = 0; k < vOrder.size(); k += 2) {
+        const size_t i = vOrder[k].second;
+        CBigNum bnTerm;
+        if (k + 1 < vOrder.size()) {
+            const size_t j = vOrder[k + 1].second;
+            bnTerm = vBases[i].pow2_mod(vExps[i], vBases[j], vExps[j], m);
+        } else {
+            bnTerm = vBases[i].pow_mod(vExps[i], m);
+        }
+        result = k == 0 ? bnTerm : result.mul_mod(bnTerm, m);
+    }
+    return result % m;
+}
+
+static inline unsigned int GetBit(const std::vector<unsigned char>& vch, unsigned int nBit)
+{
+    return nBit / 8 < vch.size() ? (vch[nBit / 8] >> (nBit % 8)) & 1 : 0;
+}
+
+MontgomeryContext::MontgomeryContext(const CBigNum& bnModulus) : modulus(bnModulus)
+{
+    if (modulus <= CBigNum(1) || modulus % CBigNum(2) != CBigNum(1))
+        throw std::runtime_error("MontgomeryContext: modulus must be odd");
+    if ((unsigned int)modulus.bitSize() > MONT_MAX_BITS)
+        throw std::runtime_error("MontgomeryContext: modulus is too wide");
+
+    nLimbs = (modulus.bitSize() + MONT_LIMB_BITS - 1) / MONT_LIMB_BITS;
+    LoadLimbs(modulus, mod, nLimbs);
+
+    // Newton iteration for m^-1 mod 2^MONT_LIMB_BITS, each step doubles the correct low bits
+    mont_limb_t inv = mod[0];
+    for (int i = 0; i < 6; i++)
+        inv *= 2 - mod[0] * inv;
+    n0inv = (mont_limb_t)0 - inv;
+
+    CBigNum bnR = CBigNum(1) << (MONT_LIMB_BITS * nLimbs);
+    LoadLimbs(bnR % modulus, one.limb, nLimbs);
+    LoadLimbs((bnR * bnR) % modulus, rr.limb, nLimbs);
+}
+
+void MontgomeryContext::mul(const mont_limb_t* a, const mont_limb_t* b, mont_limb_t* r) const
+{
+    mont_limb_t t[MONT_MAX_LIMBS + 1];
+    memset(t, 0, (nLimbs + 1) * MONT_LIMB_BYTES);
+
+    for (unsigned int i = 0; i < nLimbs; i++) {
+        // t = (t + a * b[i] + u * m) / 2^MONT_LIMB_BITS, with u chosen so the low limb cancels
+        const mont_limb_t bi = b[i];
+        mont_dlimb_t s1 = (mont_dlimb_t)a[0] * bi + t[0];
+        const mont_limb_t u = (mont_limb_t)s1 * n0inv;
+        mont_dlimb_t s2 = (mont_dlimb_t)u * mod[0] + (mont_limb_t)s1;
+        mont_limb_t c1 = (mont_limb_t)(s1 >> MONT_LIMB_BITS);
+        mont_limb_t c2 = (mont_limb_t)(s2 >> MONT_LIMB_BITS);
+        for (unsigned int j = 1; j < nLimbs; j++) {
+            s1 = (mont_dlimb_t)a[j] * bi + t[j] + c1;
+            s2 = (mont_dlimb_t)u * mod[j] + (mont_limb_t)s1 + c2;
+            c1 = (mont_limb_t)(s1 >> MONT_LIMB_BITS);
+            c2 = (mont_limb_t)(s2 >> MONT_LIMB_BITS);
+            t[j - 1] = (mont_limb_t)s2;
+        }
+        s1 = (mont_dlimb_t)t[nLimbs] + c1 + c2;
+        t[nLimbs - 1] = (mont_limb_t)s1;
+        t[nLimbs] = (mont_limb_t)(s1 >> MONT_LIMB_BITS);
+    }
+
+    // t < 2m, subtract m once if t >= m
+    mont_limb_t sub[MONT_MAX_LIMBS];
+    mont_limb_t borrow = 0;
+    for (unsigned int j = 0; j < nLimbs; j++) {
+        mont_dlimb_t d = (mont_dlimb_t)t[j] - mod[j] - borrow;
+        sub[j] = (mont_limb_t)d;
+        borrow = (mont_limb_t)(d >> MONT_LIMB_BITS) & 1;
+    }
+    memcpy(r, (t[nLimbs] != 0 || borrow == 0) ? sub : t, nLimbs * MONT_LIMB_BYTES);
+}
+
+void MontgomeryContext::setOne(MontgomeryNum& r) const
+{
+    memcpy(r.limb, one.limb, nLimbs * MONT_LIMB_BYTES);
+}
+
+void MontgomeryContext::toMont(const CBigNum& x, MontgomeryNum& r) const
+{
+    CBigNum xr = x % modulus;
+    if (xr < CBigNum(0))
+        xr += modulus;
+    MontgomeryNum t;
+    LoadLimbs(xr, t.limb, nLimbs);
+    mul(t, rr, r);
+}
+
+CBigNum MontgomeryContext::fromMont(const MontgomeryNum& a) const
+{
+    MontgomeryNum t, r;
+    memset(t.limb, 0, nLimbs * MONT_LIMB_BYTES);
+    t.limb[0] = 1;
+    mul(a, t, r);
+    return StoreLimbs(r.limb, nLimbs);
+}
+
+void MontgomeryContext::pow(const MontgomeryNum& base, const CBigNum& e, MontgomeryNum& r) const
+{
+    int nBits = e.bitSize();
+    if (nBits <= 0) {
+        setOne(r);
+        return;
+    }
+    std::vector<unsigned char> vch = e.getvch();
+
+    // odd powers base^1, base^3, ..., base^(2^w - 1)
+    int w = nBits > 512 ? 5 : nBits > 64 ? 4 : nBits > 8 ? 3 : 1;
+    MontgomeryNum odd[16];
+    odd[0] = base;
+    if (w > 1) {
+        MontgomeryNum sq;
+        mul(base, base, sq);
+        for (int i = 1; i < (1 << (w - 1)); i++)
+            mul(odd[i - 1], sq, odd[i]);
+    }
+
+    // left to right sliding window, the top bit of e is set so acc starts with a window
+    MontgomeryNum acc;
+    bool fStarted = false;
+    int i = nBits - 1;
+    while (i >= 0) {
+        if (!GetBit(vch, i)) {
+            mul(acc, acc, acc);
+            i--;
+            continue;
+        }
+        int j = std::max(i - w + 1, 0);
+        while (!GetBit(vch, j))
+            j++;
+        unsigned int nWindow = 0;
+        for (int k = i; k >= j; k--)
+            nWindow = (nWindow << 1) | GetBit(vch, k);
+
+        if (fStarted) {
+            for (int k = 0; k <= i - j; k++)
+                mul(acc, acc, acc);
+            mul(acc, odd[nWindow >> 1], acc);
+        } else {
+            acc = odd[nWindow >> 1];
+            fStarted = true;
+        }
+        i = j - 1;
+    }
+    r = acc;
+}
+
+CBigNum MontgomeryContext::pow_mod(const CBigNum& base, const CBigNum& e) const
+{
+    MontgomeryNum b, r;
+    if (e < CBigNum(0)) {
+        // g^-x = (g^-1)^x
+        toMont(base.inverse(modulus), b);
+        pow(b, e * -1, r);
+    } else {
+        toMont(base, b);
+        pow(b, e, r);
+    }
+    return fromMont(r);
+}
+
+CBigNum MontgomeryContext::mul_mod(const CBigNum& a, const CBigNum& b) const
+{
+    // (a * R) * b * R^-1 = a * b
+    MontgomeryNum am, bl, r;
+    toMont(a, am);
+    CBigNum br = b % modulus;
+    if (br < CBigNum(0))
+        br += modulus;
+    LoadLimbs(br, bl.limb, nLimbs);
+    mul(am, bl, r);
+    return StoreLimbs(r.limb, nLimbs);
+}
+
+FixedBaseTable::FixedBaseTable(const MontgomeryContext& ctxIn, const CBigNum& bnBase, unsigned int nMaxBitsIn) : ctx(ctxIn), base(bnBase), nMaxBits(nMaxBitsIn)
+{
+    const unsigned int nLimbs = ctx.getLimbs();
+    const unsigned int nEntries = (1 << MONT_FIXED_BASE_WINDOW) - 1;
+    const unsigned int nRows = (nMaxBits + MONT_FIXED_BASE_WINDOW - 1) / MONT_FIXED_BASE_WINDOW;
+    vTable.resize((size_t)nRows * nEntries * nLimbs);
+
+    // row i holds base^(d * 2^(w*i)) for d = 1 .. 2^w - 1
+    MontgomeryNum rowBase;
+    ctx.toMont(base, rowBase);
+    for (unsigned int i = 0; i < nRows; i++) {
+        mont_limb_t* row = &vTable[(size_t)i * nEntries * nLimbs];
+        memcpy(row, rowBase.limb, nLimbs * sizeof(mont_limb_t));
+        for (unsigned int d = 1; d < nEntries; d++)
+            ctx.mul(row + (d - 1) * nLimbs, rowBase.limb, row + d * nLimbs);
+        ctx.mul(row + (nEntries - 1) * nLimbs, rowBase.limb, rowBase.limb);
+    }
+}
+
+void FixedBaseTable::mulPow(const CBigNum& e, MontgomeryNum& r) const
+{
+    if (e < CBigNum(0) || (unsigned int)e.bitSize() > nMaxBits) {
+        MontgomeryNum t;
+        ctx.toMont(base.pow_mod(e, ctx.getModulus()), t);
+        ctx.mul(r, t, r);
+        return;
+    }
+
+    const unsigned int nLimbs = ctx.getLimbs();
+    const unsigned int nEntries = (1 << MONT_FIXED_BASE_WINDOW) - 1;
+    std::vector<unsigned char> vch = e.getvch();
+    for (unsigned int i = 0; i * MONT_FIXED_BASE_WINDOW < (unsigned int)e.bitSize(); i++) {
+        unsigned int d = 0;
+        for (unsigned int k = MONT_FIXED_BASE_WINDOW; k-- > 0;)
+            d = (d << 1) | GetBit(vch, i * MONT_FIXED_BASE_WINDOW + k);
+        if (d)
+            ctx.mul(r.limb, &vTable[((size_t)i * nEntries + d - 1) * nLimbs], r.limb);
+    }
+}
+
+CBigNum FixedBaseTable::pow_mod(const CBigNum& e) const
+{
+    MontgomeryNum r;
+    ctx.setOne(r);
+    mulPow(e, r);
+    return ctx.fromMont(r);
+}
+
+//! Convert a non-negative CBigNum to an OpenSSL BIGNUM owned by the caller
+static BIGNUM* NewBN(const CBigNum& x)
+{
+    // getvch is little endian with a trailing sign byte, BN_bin2bn wants big endian
+    std::vector<unsigned char> vch = x.getvch();
+    std::reverse(vch.begin(), vch.end());
+    BIGNUM* bn = BN_bin2bn(vch.empty() ? NULL : &vch[0], vch.size(), NULL);
+    if (!bn)
+        throw std::runtime_error("RepeatedBaseTable: BN_bin2bn failed");
+    return bn;
+}
+
+static CBigNum FromBN(const BIGNUM* bn)
+{
+    std::vector<unsigned char> vch(BN_num_bytes(bn));
+    BN_bn2bin(bn, vch.empty() ? NULL : &vch[0]);
+    std::reverse(vch.begin(), vch.end());
+    vch.push_back(0);
+    return CBigNum(vch);
+}
+
+RepeatedBaseTable::RepeatedBaseTable(const CBigNum& modulusIn, const CBigNum& baseIn, unsigned int nMaxBitsIn) : modulus(modulusIn), base(baseIn), nMaxBits(nMaxBitsIn), pmont(NULL)
+{
+    if (modulus <= CBigNum(1) || modulus % CBigNum(2) != CBigNum(1))
+        return;
+
+    CAutoBN_CTX pctx;
+    BIGNUM* bnModulus = NewBN(modulus);
+    pmont = BN_MONT_CTX_new();
+    bool fOk = pmont && BN_MONT_CTX_set(pmont, bnModulus, pctx);
+    BN_free(bnModulus);
+    if (!fOk)
+        throw std::runtime_error("RepeatedBaseTable: BN_MONT_CTX_set failed");
+
+    // row i is row i-1 squared w times
+    const unsigned int nRows = (nMaxBits + WINDOW - 1) / WINDOW;
+    BIGNUM* bnBase = NewBN(base % modulus);
+    vRows.push_back(BN_new());
+    fOk = vRows[0] && BN_to_montgomery(vRows[0], bnBase, pmont, pctx);
+    BN_free(bnBase);
+    for (unsigned int i = 1; fOk && i < nRows; i++) {
+        BIGNUM* bnRow = BN_dup(vRows[i - 1]);
+        vRows.push_back(bnRow);
+        for (unsigned int k = 0; fOk && k < WINDOW; k++)
+            fOk = bnRow && BN_mod_mul_montgomery(bnRow, bnRow, bnRow, pmont, pctx);
+    }
+    if (!fOk)
+        throw std::runtime_error("RepeatedBaseTable: building the table failed");
+}
+
+RepeatedBaseTable::~RepeatedBaseTable()
+{
+    for (size_t i = 0; i < vRows.size(); i++)
+        BN_free(vRows[i]);
+    if (pmont)
+        BN_MONT_CTX_free(pmont);
+}
+
+CBigNum RepeatedBaseTable::pow_mod(const CBigNum& e) const
+{
+    if (!pmont || e < CBigNum(0) || (unsigned int)e.bitSize() > nMaxBits)
+        return base.pow_mod(e, modulus);
+
+    // split e into w bit digits, then for d = 2^w - 1 down to 1: b *= rows with digit d, a *= b
+    std::vector<unsigned char> vch = e.getvch();
+    const unsigned int nDigits = (e.bitSize() + WINDOW - 1) / WINDOW;
+    std::vector<unsigned int> vDigits(nDigits);
+    for (unsigned int i = 0; i < nDigits; i++) {
+        for (unsigned int k = WINDOW; k-- > 0;)
+            vDigits[i] = (vDigits[i] << 1) | GetBit(vch, i * WINDOW + k);
+    }
+
+    CAutoBN_CTX pctx;
+    BIGNUM* a = BN_new();
+    BIGNUM* b = BN_new();
+    bool fOk = a && b;
+    bool fA = false, fB = false;
+    for (unsigned int d = (1 << WINDOW) - 1; fOk && d > 0; d--) {
+        for (unsigned int i = 0; fOk && i < nDigits; i++) {
+            if (vDigits[i] != d)
+                continue;
+            fOk = fB ? BN_mod_mul_montgomery(b, b, vRows[i], pmont, pctx) : BN_copy(b, vRows[i]) != NULL;
+            fB = true;
+        }
+        if (fOk && fB) {
+            fOk = fA ? BN_mod_mul_montgomery(a, a, b, pmont, pctx) : BN_copy(a, b) != NULL;
+            fA = true;
+        }
+    }
+
+    CBigNum result;
+    if (fOk) {
+        if (fA)
+            fOk = BN_from_montgomery(a, a, pmont, pctx);
+        else
+            fOk = BN_one(a);
+    }
+    if (fOk)
+        result = FromBN(a);
+    BN_free(a);
+    BN_free(b);
+    if (!fOk)
+        throw std::runtime_error("RepeatedBaseTable::pow_mod: OpenSSL arithmetic failed");
+    return result;
+}
+
+GroupArithmetic::GroupArithmetic(const CBigNum& modulusIn, const CBigNum& gIn, const CBigNum& hIn, const CBigNum& orderIn) : modulus(modulusIn), g(gIn), h(hIn), order(orderIn)
+{
+    fReduceExponents = order > CBigNum(0) && g.pow_mod(order, modulus) == CBigNum(1) && h.pow_mod(order, modulus) == CBigNum(1);
+    const unsigned int nMaxExpBits = fReduceExponents ? order.bitSize() : modulus.bitSize();
+#ifdef USE_ZEROCOIN_MONTGOMERY
+    pctx = new MontgomeryContext(modulus);
+    ptableG = new FixedBaseTable(*pctx, g, nMaxExpBits);
+    ptableH = new FixedBaseTable(*pctx, h, nMaxExpBits);
+#endif
+}
+
+GroupArithmetic::~GroupArithmetic()
+{
+#ifdef USE_ZEROCOIN_MONTGOMERY
+    delete ptableH;
+    delete ptableG;
+    delete pctx;
+#endif
+}
+
+CBigNum GroupArithmetic::powG(const CBigNum& e) const
+{
+#ifdef USE_ZEROCOIN_MONTGOMERY
+    return ptableG->pow_mod(ReduceExponent(e));
+#else
+    return g.pow_mod(ReduceExponent(e), modulus);
+#endif
+}
+
+CBigNum GroupArithmetic::powH(const CBigNum& e) const
+{
+#ifdef USE_ZEROCOIN_MONTGOMERY
+    return ptableH->pow_mod(ReduceExponent(e));
+#else
+    return h.pow_mod(ReduceExponent(e), modulus);
+#endif
+}
+
+CBigNum GroupArithmetic::powGH(const CBigNum& e1, const CBigNum& e2) const
+{
+#ifdef USE_ZEROCOIN_MONTGOMERY
+    MontgomeryNum r;
+    pctx->setOne(r);
+    ptableG->mulPow(ReduceExponent(e1), r);
+    ptableH->mulPow(ReduceExponent(e2), r);
+    return pctx->fromMont(r);
+#else
+    return g.pow2_mod(ReduceExponent(e1), h, ReduceExponent(e2), modulus);
+#endif
+}
+
+CBigNum GroupArithmetic::multiExp(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNum& eG, const CBigNum& eH) const
+{
+    if (vBases.size() != vExps.size())
+        throw std::runtime_error("GroupArithmetic::multiExp: bases and exponents differ in number");
+
+#ifdef USE_ZEROCOIN_MONTGOMERY
+    if (vBases.empty())
+        return powGH(eG, eH);
+    return MultiExpPairwise(vBases, vExps, modulus).mul_mod(powGH(eG, eH), modulus);
+#else
+    std::vector<CBigNum> vAllBases(vBases);
+    std::vector<CBigNum> vAllExps(vExps);
+    vAllBases.push_back(g);
+    vAllExps.push_back(ReduceExponent(eG));
+    vAllBases.push_back(h);
+    vAllExps.push_back(ReduceExponent(eH));
+    return MultiExpPairwise(vAllBases, vAllExps, modulus);
+#endif
+}
+
+CBigNum GroupArithmetic::pow_mod(const CBigNum& base, const CBigNum& e) const
+{
+    return base.pow_mod(e, modulus);
+}
+
+CBigNum GroupArithmetic::mul_mod(const CBigNum& a, const CBigNum& b) const
+{
+    return a.mul_mod(b, modulus);
+}
+
+} /* namespace libzerocoin */
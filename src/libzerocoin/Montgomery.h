@@ -0,0 +1,198 @@
+/**
+ * @file       Montgomery.h
+ *
+ * @brief      Fixed width Montgomery arithmetic for the Zerocoin library.
+ *
+ * @copyright  Copyright 2018 The OPCX developers
+ * @license    This project is released under the MIT license.
+ **/
+
+#ifndef MONTGOMERY_H_
+#define MONTGOMERY_H_
+
+#if defined(HAVE_CONFIG_H)
+#include "config/opcx-config.h"
+#endif
+
+#include "bignum.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace libzerocoin {
+
+#if defined(__SIZEOF_INT128__)
+typedef uint64_t mont_limb_t;
+typedef unsigned __int128 mont_dlimb_t;
+#else
+typedef uint32_t mont_limb_t;
+typedef uint64_t mont_dlimb_t;
+#endif
+
+static const unsigned int MONT_LIMB_BITS = sizeof(mont_limb_t) * 8;
+//! Widest modulus supported by MontgomeryContext
+static const unsigned int MONT_MAX_BITS = 3072;
+static const unsigned int MONT_MAX_LIMBS = MONT_MAX_BITS / MONT_LIMB_BITS;
+//! Window width of the fixed-base tables
+static const unsigned int MONT_FIXED_BASE_WINDOW = 4;
+
+/**
+ * A residue in Montgomery form (a * R mod m), least significant limb first.
+ * Its size is fixed so that temporaries live on the stack, only the first
+ * nLimbs limbs of its context are used.
+ */
+struct MontgomeryNum {
+    mont_limb_t limb[MONT_MAX_LIMBS];
+};
+
+/**
+ * Precomputed constants for Montgomery multiplication modulo one odd
+ * modulus of at most MONT_MAX_BITS bits.
+ */
+class MontgomeryContext
+{
+public:
+    /**
+     * @param bnModulus  an odd modulus
+     * @throw std::runtime_error if the modulus is even or too wide
+     */
+    explicit MontgomeryContext(const CBigNum& bnModulus);
+
+    const CBigNum& getModulus() const { return modulus; }
+    unsigned int getLimbs() const { return nLimbs; }
+
+    //! Convert x (reduced mod m first, may be negative) into Montgomery form
+    void toMont(const CBigNum& x, MontgomeryNum& r) const;
+    CBigNum fromMont(const MontgomeryNum& a) const;
+
+    //! r = a * b * R^-1 mod m, r may alias a or b
+    void mul(const mont_limb_t* a, const mont_limb_t* b, mont_limb_t* r) const;
+    void mul(const MontgomeryNum& a, const MontgomeryNum& b, MontgomeryNum& r) const { mul(a.limb, b.limb, r.limb); }
+    void setOne(MontgomeryNum& r) const;
+
+    //! r = base^e with a sliding window, e must not be negative
+    void pow(const MontgomeryNum& base, const CBigNum& e, MontgomeryNum& r) const;
+
+    //! Drop-in equivalents of CBigNum::pow_mod and CBigNum::mul_mod for this modulus
+    CBigNum pow_mod(const CBigNum& base, const CBigNum& e) const;
+    CBigNum mul_mod(const CBigNum& a, const CBigNum& b) const;
+
+private:
+    CBigNum modulus;
+    unsigned int nLimbs;
+    mont_limb_t mod[MONT_MAX_LIMBS];
+    mont_limb_t n0inv; //!< -m^-1 mod 2^MONT_LIMB_BITS
+    MontgomeryNum one; //!< R mod m
+    MontgomeryNum rr;  //!< R^2 mod m
+};
+
+/**
+ * Powers base^(d * 2^(w*i)) of a fixed base for every window position i and
+ * digit d, so that base^e costs one multiplication per non-zero window of e
+ * and no squarings. Exponents wider than the table or negative fall back to
+ * CBigNum::pow_mod.
+ */
+class FixedBaseTable
+{
+public:
+    FixedBaseTable(const MontgomeryContext& ctxIn, const CBigNum& bnBase, unsigned int nMaxBitsIn);
+
+    //! r = r * base^e
+    void mulPow(const CBigNum& e, MontgomeryNum& r) const;
+    CBigNum pow_mod(const CBigNum& e) const;
+
+private:
+    const MontgomeryContext& ctx;
+    CBigNum base;
+    unsigned int nMaxBits;
+    //! rows of (2^w - 1) entries of ctx.getLimbs() limbs each
+    std::vector<mont_limb_t> vTable;
+};
+
+/**
+ * Powers base^(2^(w*i)) of one base that is raised to many exponents, such as
+ * the coin commitment in SerialNumberSignatureOfKnowledge::Verify. With the
+ * Brickell-Gordon-McCurley-Wilson method each exponentiation then costs about
+ * nBits/w + 2^w multiplications and no squarings, so the table pays for
+ * itself after a handful of exponentiations. It uses OpenSSL's Montgomery
+ * multiplication, so it helps in every build. Exponents wider than the table
+ * or negative, and even moduli, fall back to CBigNum::pow_mod.
+ */
+class RepeatedBaseTable
+{
+public:
+    RepeatedBaseTable(const CBigNum& modulusIn, const CBigNum& baseIn, unsigned int nMaxBitsIn);
+    ~RepeatedBaseTable();
+
+    CBigNum pow_mod(const CBigNum& e) const;
+
+    //! Window width of the table
+    static const unsigned int WINDOW = 5;
+
+private:
+    CBigNum modulus;
+    CBigNum base;
+    unsigned int nMaxBits;
+    BN_MONT_CTX* pmont;
+    //! base^(2^(w*i)) in Montgomery form
+    std::vector<BIGNUM*> vRows;
+
+    RepeatedBaseTable(const RepeatedBaseTable&);
+    RepeatedBaseTable& operator=(const RepeatedBaseTable&);
+};
+
+/**
+ * Modular arithmetic of one group, with the generators g and h as fixed bases.
+ * Built with USE_ZEROCOIN_MONTGOMERY, powers of g and h come from
+ * FixedBaseTable, otherwise everything forwards to the OpenSSL CBigNum
+ * operations. Variable bases always use OpenSSL: with no squarings to save,
+ * its assembly Montgomery multiplication beats the portable limb loop.
+ *
+ * Products of several powers are computed as simultaneous exponentiations
+ * (CBigNum::pow2_mod) over pairs of bases, sharing the squarings of each pair.
+ */
+class GroupArithmetic
+{
+public:
+    /**
+     * @param orderIn  order of g and h, or 0 if unknown. Exponents of g and h
+     *                 are reduced mod the order once g^order = h^order = 1 is
+     *                 confirmed, and the tables are built for its width.
+     */
+    GroupArithmetic(const CBigNum& modulusIn, const CBigNum& gIn, const CBigNum& hIn, const CBigNum& orderIn);
+    ~GroupArithmetic();
+
+    CBigNum powG(const CBigNum& e) const;
+    CBigNum powH(const CBigNum& e) const;
+    //! g^e1 * h^e2 mod m
+    CBigNum powGH(const CBigNum& e1, const CBigNum& e2) const;
+    /**
+     * Multi-exponentiation: vBases[0]^vExps[0] * ... * vBases[n-1]^vExps[n-1] * g^eG * h^eH mod m
+     * @throw std::runtime_error if vBases and vExps differ in length
+     */
+    CBigNum multiExp(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNum& eG, const CBigNum& eH) const;
+    CBigNum pow_mod(const CBigNum& base, const CBigNum& e) const;
+    CBigNum mul_mod(const CBigNum& a, const CBigNum& b) const;
+
+private:
+    CBigNum modulus;
+    CBigNum g;
+    CBigNum h;
+    CBigNum order;
+    bool fReduceExponents;
+#ifdef USE_ZEROCOIN_MONTGOMERY
+    MontgomeryContext* pctx;
+    FixedBaseTable* ptableG;
+    FixedBaseTable* ptableH;
+#endif
+
+    //! e mod order for the exponents of g and h, when that is known to be exact
+    CBigNum ReduceExponent(const CBigNum& e) const { return fReduceExponents ? e % order : e; }
+
+    GroupArithmetic(const GroupArithmetic&);
+    GroupArithmetic& operator=(const GroupArithmetic&);
+};
+
+} /* namespace libzerocoin */
+
+#endif /* MONTGOMERY_H_ */
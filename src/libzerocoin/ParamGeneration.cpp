@@ -91,6 +91,7 @@ CalculateParams(ZerocoinParams &params, CBigNum N, string aux, uint32_t security
 	params.accumulatorParams.accumulatorQRNCommitmentGroup.h = generateIntegerFromSeed(NLen - 1,
 	        calculateSeed(N, aux, securityLevel, STRING_QRNCOMMIT_GROUPH),
 											 &resultCtr).pow_mod(CBigNum(2), N);
+	params.accumulatorParams.accumulatorQRNCommitmentGroup.precompute(params.accumulatorParams.accumulatorModulus);
 
 	// Calculate the accumulator base, which we calculate as "u = C**2 mod N"
 	// where C is an arbitrary value. In the unlikely case that "u = 1" we increment
@@ -278,6 +279,7 @@ deriveIntegerGroupParams(uint256 seed, uint32_t pLen, uint32_t qLen)
 		throw std::runtime_error("Group parameters are not valid");
 	}
 
+	result.precompute();
 	return result;
 }
 
@@ -331,6 +333,7 @@ deriveIntegerGroupFromOrder(CBigNum &groupOrder)
 				throw std::runtime_error("Group parameters are not valid");
 			}
 
+			result.precompute();
 			return result;
 		}
 	}
@@ -44,4 +44,15 @@ CBigNum IntegerGroupParams::randomElement() const {
 	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
 }
 
+void IntegerGroupParams::precompute(const CBigNum& bnModulus) {
+	this->arith.reset(new GroupArithmetic(bnModulus, this->g, this->h, this->groupOrder));
+}
+
+const GroupArithmetic& IntegerGroupParams::arithmetic() const {
+	if (!this->arith) {
+		throw std::runtime_error("Group arithmetic is not precomputed");
+	}
+	return *this->arith;
+}
+
 } /* namespace libzerocoin */
@@ -14,8 +14,11 @@
 #define PARAMS_H_
 
 #include "bignum.h"
+#include "Montgomery.h"
 #include "ZerocoinDefines.h"
 
+#include <memory>
+
 namespace libzerocoin {
 
 class IntegerGroupParams {
@@ -31,6 +34,20 @@ public:
 	 * @return a random element in the group.
 	 */
 	CBigNum randomElement() const;
+
+	/**
+	 * Precompute the modular arithmetic of the group.
+	 * @param bnModulus the modulus to work in, if it differs from "modulus"
+	 */
+	void precompute(const CBigNum& bnModulus);
+	void precompute() { precompute(modulus); }
+
+	/**
+	 * The precomputed arithmetic of the group.
+	 * @throw std::runtime_error if precompute() was not called
+	 */
+	const GroupArithmetic& arithmetic() const;
+
 	bool initialized;
 
 	/**
@@ -62,7 +79,13 @@ public:
 		    READWRITE(h);
 		    READWRITE(modulus);
 		    READWRITE(groupOrder);
-	}	
+		    if (ser_action.ForRead() && modulus > CBigNum(1))
+		        precompute();
+	}
+
+private:
+	//! Shared by copies of the group, not serialized
+	std::shared_ptr<const GroupArithmetic> arith;
 };
 
 class AccumulatorAndProofParams {
@@ -123,7 +146,8 @@ public:
 
 	/**
 	 * Hidden order quadratic residue group mod N.
-	 * Used in the accumulator proof.
+	 * Used in the accumulator proof. Its modulus is not set,
+	 * its arithmetic is precomputed for accumulatorModulus.
 	 */
 	IntegerGroupParams accumulatorQRNCommitmentGroup;
 
@@ -149,6 +173,8 @@ public:
 	    READWRITE(maxCoinValue);
 	    READWRITE(k_prime);
 	    READWRITE(k_dprime);
+	    if (ser_action.ForRead() && accumulatorModulus > CBigNum(1))
+	        accumulatorQRNCommitmentGroup.precompute(accumulatorModulus);
   }
 };
 
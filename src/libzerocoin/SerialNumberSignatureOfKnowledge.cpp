@@ -110,40 +110,47 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_exp,const CBigNum& b_exp,
         const CBigNum& h_exp) const {
 
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
-
-	CBigNum exponent = (a.pow_mod(a_exp, params->serialNumberSoKCommitmentGroup.groupOrder)
-	                   * b.pow_mod(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
+	// a, b are the generators of the coin commitment group, whose modulus is the order of the serial number group
+	CBigNum exponent = params->coinCommitmentGroup.arithmetic().powGH(a_exp, b_exp);
 
-	return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
+	return params->serialNumberSoKCommitmentGroup.arithmetic().powGH(exponent, h_exp);
 }
 
 bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
         const uint256 msghash) const {
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
+	const GroupArithmetic& arithCoin = params->coinCommitmentGroup.arithmetic();
+	const GroupArithmetic& arithSoK = params->serialNumberSoKCommitmentGroup.arithmetic();
 	CHashWriter hasher(0,0);
 	hasher << *params << valueOfCommitmentToCoin << coinSerialNumber << msghash;
 
 	vector<CBigNum> tprime(params->zkp_iterations);
 	unsigned char *hashbytes = (unsigned char*) &this->hash;
 
+	// Every iteration with a zero challenge bit raises the commitment to an exponent below
+	// the coin commitment modulus, share the squarings of all of them through one table
+	unique_ptr<RepeatedBaseTable> ptableCommitment;
+	uint32_t nZeroBits = 0;
+	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
+		if (!((hashbytes[i / 8] >> (i % 8)) & 0x01))
+			nZeroBits++;
+	}
+	if (nZeroBits >= SOK_REPEATED_BASE_MIN_USES)
+		ptableCommitment.reset(new RepeatedBaseTable(params->serialNumberSoKCommitmentGroup.modulus, valueOfCommitmentToCoin,
+		                                             params->coinCommitmentGroup.modulus.bitSize()));
+
 	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
 		int bit = i % 8;
 		int byte = i / 8;
 		bool challenge_bit = ((hashbytes[byte] >> bit) & 0x01);
 		if(challenge_bit) {
 			tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], SeedTo1024(sprime[i].getuint256()));
+		} else if (ptableCommitment) {
+			CBigNum exp = arithCoin.powH(s_notprime[i]);
+			tprime[i] = arithSoK.mul_mod(ptableCommitment->pow_mod(exp), arithSoK.powH(sprime[i]));
 		} else {
-			CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-			tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus) *
-			             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus)) %
-			            params->serialNumberSoKCommitmentGroup.modulus;
+			vector<CBigNum> vBases(1, valueOfCommitmentToCoin);
+			vector<CBigNum> vExps(1, arithCoin.powH(s_notprime[i]));
+			tprime[i] = arithSoK.multiExp(vBases, vExps, CBigNum(0), sprime[i]);
 		}
 	}
 	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
@@ -17,6 +17,7 @@
 #include <list>
 #include <vector>
 #include <bitset>
+#include <memory>
 #include "Params.h"
 #include "Coin.h"
 #include "Commitment.h"
@@ -28,6 +29,9 @@
 using namespace std;
 namespace libzerocoin {
 
+//! Zero challenge bits from which SerialNumberSignatureOfKnowledge::Verify tabulates the powers of the commitment
+static const uint32_t SOK_REPEATED_BASE_MIN_USES = 4;
+
 /**A Signature of knowledge on the hash of metadata attesting that the signer knows the values
  *  necessary to open a commitment which contains a coin(which it self is of course a commitment)
  * with a given serial number.
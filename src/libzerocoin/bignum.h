@@ -544,6 +544,34 @@ public:
         return ret;
     }
 
+    /**
+     * simultaneous modular exponentiation: this^e1 * b^e2 mod m
+     * The squarings are shared between both exponents (Shamir's trick), so
+     * this costs little more than the wider of the two exponentiations.
+     * @param e1 exponent of this
+     * @param b second base
+     * @param e2 exponent of b
+     * @param m modulus
+     */
+    CBigNum pow2_mod(const CBigNum& e1, const CBigNum& b, const CBigNum& e2, const CBigNum& m) const {
+        // BN_mod_exp2_mont needs an odd modulus and non-negative exponents, g^-x = (g^-1)^x
+        if (!BN_is_odd(m.bn))
+            return this->pow_mod(e1, m).mul_mod(b.pow_mod(e2, m), m);
+        if (e1 < 0)
+            return this->inverse(m).pow2_mod(e1 * -1, b, e2, m);
+        if (e2 < 0)
+            return this->pow2_mod(e1, b.inverse(m), e2 * -1, m);
+
+        CAutoBN_CTX pctx;
+        CBigNum ret;
+        CBigNum a1 = *this % m;
+        CBigNum a2 = b % m;
+        if (!BN_mod_exp2_mont(ret.bn, a1.bn, e1.bn, a2.bn, e2.bn, m.bn, pctx, NULL))
+            throw bignum_error("CBigNum::pow2_mod : BN_mod_exp2_mont failed");
+
+        return ret;
+    }
+
    /**
     * Calculates the inverse of this element mod m.
     * i.e. i such this*i = 1 mod m
@@ -11,6 +11,7 @@
 #include "accumulators.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -32,11 +33,13 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
+#include "zerocoinspendcache.h"
 #include "autoupdatemodel.h"
 #include "accumulatormap.h"
 #include "primitives/zerocoin.h"
 #include "libzerocoin/Denominations.h"
 
+#include <atomic>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -79,7 +82,7 @@ bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 int64_t nReserveBalance = 0;
 
@@ -311,6 +314,12 @@ struct CNodeState {
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
+    //! Whether this peer sent sendcmpct, so that new blocks can be requested as compact blocks.
+    bool fSupportsCompactBlocks;
+    //! Blocks requested from this peer with MSG_CMPCT_BLOCK.
+    std::set<uint256> setCompactBlocksRequested;
+    //! The compact block waiting for the reply to our getblocktxn.
+    boost::shared_ptr<PartiallyDownloadedBlock> partialBlock;
     //! Blocks sent by this node
     CNodeBlocks nodeBlocks;
 
@@ -328,6 +337,7 @@ struct CNodeState {
         nBlocksInFlight = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
+        fSupportsCompactBlocks = false;
     }
 };
 
@@ -635,6 +645,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewAsyncFlush* pcoinsFlush = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
@@ -1068,12 +1079,8 @@ void FindMints(vector<CZerocoinMint> vMintsToFind, vector<CZerocoinMint>& vMints
             if(chainActive[i]->vMintDenominationsInBlock.empty())
                 continue;
 
-            CBlock block;
-            if(!ReadBlockFromDisk(block, chainActive[i]))
-                continue;
-
             list<CZerocoinMint> vMints;
-            if(!BlockToZerocoinMintList(block, vMints, true))
+            if(!GetBlockMints(chainActive[i], vMints, true))
                 continue;
 
             // search the blocks mints to see if it contains the mint that is requesting meta data updates
@@ -1264,6 +1271,83 @@ bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMin
     return true;
 }
 
+bool BlockToMintIndex(const CBlock& block, vector<CZerocoinBlockMintTx>& vMintTxs)
+{
+    for (const CTransaction& tx : block.vtx) {
+        if(!tx.IsZerocoinMint())
+            continue;
+
+        CZerocoinBlockMintTx mintTx;
+        mintTx.txid = tx.GetHash();
+        for (const CTxIn& in : tx.vin)
+            mintTx.vPrevouts.push_back(in.prevout);
+
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            const CTxOut& txOut = tx.vout[i];
+            if(!txOut.scriptPubKey.IsZerocoinMint())
+                continue;
+
+            CValidationState state;
+            PublicCoin pubCoin(Params().Zerocoin_Params());
+            if (!TxOutToPublicCoin(txOut, pubCoin, state))
+                return false;
+
+            mintTx.vMints.push_back(CZerocoinBlockMint(i, pubCoin.getDenomination(), pubCoin.getValue()));
+        }
+        vMintTxs.push_back(mintTx);
+    }
+
+    return true;
+}
+
+bool GetBlockMints(const CBlockIndex* pindex, list<CZerocoinMint>& listMints, bool fFilterInvalid)
+{
+    vector<CZerocoinBlockMintTx> vMintTxs;
+    if (!zerocoinDB->ReadBlockMints(pindex->GetBlockHash(), vMintTxs)) {
+        // Blocks connected before the index existed are read from disk, only ConnectBlock writes the index
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            return error("%s : failed to read block %d from disk", __func__, pindex->nHeight);
+        if (!BlockToMintIndex(block, vMintTxs))
+            return error("%s : failed to get zerocoin mints from block %d", __func__, pindex->nHeight);
+    }
+
+    for (const CZerocoinBlockMintTx& mintTx : vMintTxs) {
+        // Filter out mints that have used invalid outpoints
+        if (fFilterInvalid) {
+            bool fValid = true;
+            for (const COutPoint& prevout : mintTx.vPrevouts) {
+                if (!ValidOutPoint(prevout, INT_MAX)) {
+                    fValid = false;
+                    break;
+                }
+            }
+            if (!fValid)
+                continue;
+        }
+
+        // Like BlockToPubcoinList, an invalid outpoint among the outputs drops the mints from there on
+        unsigned int nOutChecked = 0;
+        for (const CZerocoinBlockMint& blockMint : mintTx.vMints) {
+            bool fValid = true;
+            for (; fFilterInvalid && nOutChecked <= blockMint.nOut; nOutChecked++) {
+                if (!ValidOutPoint(COutPoint(mintTx.txid, nOutChecked), INT_MAX)) {
+                    fValid = false;
+                    break;
+                }
+            }
+            if (!fValid)
+                break;
+
+            CZerocoinMint mint(blockMint.denomination, blockMint.value, 0, 0, false);
+            mint.SetTxHash(mintTx.txid);
+            listMints.push_back(mint);
+        }
+    }
+
+    return true;
+}
+
 bool BlockToMintValueVector(const CBlock& block, const CoinDenomination denom, vector<CBigNum>& vValues)
 {
     for (const CTransaction tx : block.vtx) {
@@ -1362,7 +1446,7 @@ bool ContextualCheckCoinSpend(const CoinSpend& spend, CBlockIndex* pindex, const
     return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state)
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1410,16 +1494,28 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
 
         // Skip signature verification during initial block download
         if (fVerifySignature) {
-            //see if we have record of the accumulator used in the spend tx
+            //see if we have record of the accumulator used in the spend tx, even if the proof is cached
             CBigNum bnAccumulatorValue = 0;
             if(!zerocoinDB->ReadAccumulatorValue(newSpend.getAccumulatorChecksum(), bnAccumulatorValue))
                 return state.DoS(100, error("Zerocoinspend could not find accumulator associated with checksum"));
 
-            Accumulator accumulator(Params().Zerocoin_Params(), newSpend.getDenomination(), bnAccumulatorValue);
+            //Only the proof verification is skipped if the spend was already verified
+            uint256 hashSpend = CZerocoinSpendCache::GetSpendHash(newSpend);
+            if (!zerocoinSpendCache.Get(hashSpend, newSpend.getAccumulatorChecksum())) {
+                //Defer the proof verification to the check queue if the caller asked for it
+                if (pvChecks) {
+                    pvChecks->push_back(CZerocoinSpendCheck());
+                    CZerocoinSpendCheck check(newSpend, bnAccumulatorValue, tx.GetHash(), hashSpend);
+                    check.swap(pvChecks->back());
+                } else {
+                    Accumulator accumulator(Params().Zerocoin_Params(), newSpend.getDenomination(), bnAccumulatorValue);
 
-            //Check that the coin is on the accumulator
-            if(!newSpend.Verify(accumulator))
-                return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+                    //Check that the coin is on the accumulator
+                    if(!newSpend.Verify(accumulator))
+                        return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+                    zerocoinSpendCache.Set(hashSpend, newSpend.getAccumulatorChecksum());
+                }
+            }
         }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1452,7 +1548,7 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1508,7 +1604,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationS
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, pvZerocoinChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -2428,6 +2524,19 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+bool CZerocoinSpendCheck::operator()()
+{
+    if (!pspend)
+        return false;
+
+    Accumulator accumulator(Params().Zerocoin_Params(), pspend->getDenomination(), bnAccumulatorValue);
+    if (!pspend->Verify(accumulator))
+        return ::error("CZerocoinSpendCheck(): zerocoin spend with serial %s in tx %s did not verify",
+                       pspend->getCoinSerialNumber().GetHex(), txid.GetHex());
+    zerocoinSpendCache.Set(hashSpend, pspend->getAccumulatorChecksum());
+    return true;
+}
+
 CBitcoinAddress addressExp1("DQZzqnSR6PXxagep1byLiRg9ZurCZ5KieQ");
 CBitcoinAddress addressExp2("DTQYdnNqKuEHXyNeeYhPQGGGdqHbXYwjpj");
 
@@ -2811,6 +2920,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
     if (!fVerifyingBlocks) {
+        //the mints of the block are indexed again if it is connected again
+        if (pindex->nHeight >= Params().Zerocoin_StartHeight() && !zerocoinDB->EraseBlockMints(pindex->GetBlockHash()))
+            return error("DisconnectBlock(): failed to erase block mints");
+
         //if block is an accumulator checkpoint block, remove checkpoint and checksums from db
         uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
         if(nCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
@@ -2852,14 +2965,119 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+CCheckQueueHost checkqueuehost;
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, &checkqueuehost);
 
 void ThreadScriptCheck()
 {
     // DRAGAN: changed, naming
     //RenameThread("pivx-scriptch");
     RenameThread("opcx-scriptch");
-    scriptcheckqueue.Thread();
+    checkqueuehost.Thread();
+}
+
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue(4, &checkqueuehost);
+/** Only one master may drive the zerocoin spend queue at a time; CheckBlock can run outside cs_main. Only the queued checks run while it is held, so it never orders before cs_main. */
+static CCriticalSection cs_zerocoinspendcheckqueue;
+
+/**
+ * Closure representing the read of one transaction's coins from the view
+ * below pcoinsTip, so the reads for a block's inputs can run in parallel.
+ */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsView* view;
+    uint256 txid;
+    CCoins* pcoins;
+    char* pfFound;
+
+public:
+    CCoinsPrefetchCheck() : view(NULL), pcoins(NULL), pfFound(NULL) {}
+    CCoinsPrefetchCheck(const CCoinsView* viewIn, const uint256& txidIn, CCoins* pcoinsIn, char* pfFoundIn) : view(viewIn), txid(txidIn), pcoins(pcoinsIn), pfFound(pfFoundIn) {}
+
+    bool operator()()
+    {
+        *pfFound = view->GetCoins(txid, *pcoins);
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck& check)
+    {
+        std::swap(view, check.view);
+        std::swap(txid, check.txid);
+        std::swap(pcoins, check.pcoins);
+        std::swap(pfFound, check.pfFound);
+    }
+};
+
+static CCheckQueue<CCoinsPrefetchCheck> coinsprefetchqueue(16, &checkqueuehost);
+
+/** The distinct transactions whose outputs a block spends, excluding those created within the block */
+static void GetBlockPrevouts(const CBlock& block, std::vector<uint256>& vPrevouts)
+{
+    std::set<uint256> setSeen;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        setSeen.insert(tx.GetHash());
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            if (txin.scriptSig.IsZerocoinSpend())
+                continue;
+            if (setSeen.insert(txin.prevout.hash).second)
+                vPrevouts.push_back(txin.prevout.hash);
+        }
+    }
+}
+
+/**
+ * Load the coins a block spends into pcoinsTip before the block is connected,
+ * reading the ones not cached yet on the verification threads. The caller holds
+ * cs_main, so no flush can change the views below pcoinsTip between the reads
+ * and their insertion into the cache.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<uint256> vPrevouts;
+    GetBlockPrevouts(block, vPrevouts);
+
+    std::vector<uint256> vMissing;
+    BOOST_FOREACH (const uint256& txid, vPrevouts) {
+        if (!pcoinsTip->HaveCoinsInCache(txid))
+            vMissing.push_back(txid);
+    }
+
+    unsigned int nRead = 0;
+    if (!vMissing.empty()) {
+        std::vector<CCoins> vCoins(vMissing.size());
+        std::vector<char> vFound(vMissing.size(), 0);
+        std::vector<CCoinsPrefetchCheck> vChecks;
+        vChecks.reserve(vMissing.size());
+        for (unsigned int i = 0; i < vMissing.size(); i++)
+            vChecks.push_back(CCoinsPrefetchCheck(pcoinsTip->GetBackend(), vMissing[i], &vCoins[i], &vFound[i]));
+
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&coinsprefetchqueue);
+        control.Add(vChecks);
+        control.Wait();
+
+        for (unsigned int i = 0; i < vMissing.size(); i++) {
+            if (vFound[i]) {
+                pcoinsTip->AddPrefetchedCoins(vMissing[i], vCoins[i]);
+                nRead++;
+            }
+        }
+    }
+
+    LogPrint("bench", "  - Prefetch inputs of %s: %u txs, %u cached, %u read, %u not found: %.2fms\n", block.GetHash().ToString(),
+        (unsigned int)vPrevouts.size(), (unsigned int)(vPrevouts.size() - vMissing.size()), nRead, (unsigned int)vMissing.size() - nRead,
+        0.001 * (GetTimeMicros() - nTimeStart));
 }
 
 void RecalculateZPIVMinted()
@@ -2871,11 +3089,9 @@ void RecalculateZPIVMinted()
             LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
 
         //overwrite possibly wrong vMintsInBlock data
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
         std::list<CZerocoinMint> listMints;
-        BlockToZerocoinMintList(block, listMints, true);
+        bool fFoundMints = GetBlockMints(pindex, listMints, true);
+        assert(fFoundMints);
 
         vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
         pindex->vMintDenominationsInBlock.clear();
@@ -3336,6 +3552,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             return state.Abort(("Failed to record coin serial to database"));
     }
 
+    //Record the mints of the block, read back when calculating accumulator checkpoints
+    if (pindex->nHeight >= Params().Zerocoin_StartHeight()) {
+        vector<CZerocoinBlockMintTx> vMintTxs;
+        if (!BlockToMintIndex(block, vMintTxs))
+            return state.Abort(("Failed to get zerocoin mints of block"));
+        if (!zerocoinDB->WriteBlockMints(block.GetHash(), vMintTxs))
+            return state.Abort(("Failed to record block mints to database"));
+    }
+
     //Record accumulator checksums
     DatabaseChecksums(mapAccumulators);
 
@@ -3391,8 +3616,10 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     try {
+        // Snapshots still queued for the background writer hold coins in memory too
+        size_t cacheSize = pcoinsTip->DynamicMemoryUsage() + (pcoinsFlush ? pcoinsFlush->PendingMemoryUsage() : 0);
         if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && cacheSize > nCoinCacheUsage) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
@@ -3423,8 +3650,12 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             }
             pblocktree->Sync();
             // Finally flush the chainstate (which may refer to block index entries).
+            // With a background writer this only hands the dirty entries over,
+            // unless the caller needs them on disk now.
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            if (mode == FLUSH_STATE_ALWAYS && pcoinsFlush && !pcoinsFlush->Sync())
+                return state.Abort("Failed to write to coin database");
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -3447,6 +3678,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    SyncStakeModifierIndex();
 
     // If turned on AutoZeromint will automatically convert OPCX to zOPCX
     bool fZerocoinActive = chainActive.Height() >= Params().Zerocoin_StartHeight();
@@ -3457,10 +3689,10 @@ void static UpdateTip(CBlockIndex* pindexNew)
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utx)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -3565,6 +3797,16 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    if (LogAcceptCategory("bench")) {
+        std::vector<uint256> vPrevouts;
+        GetBlockPrevouts(*pblock, vPrevouts);
+        unsigned int nCached = 0;
+        BOOST_FOREACH (const uint256& txid, vPrevouts) {
+            if (pcoinsTip->HaveCoinsInCache(txid))
+                nCached++;
+        }
+        LogPrint("bench", "  - Inputs in memory: %u/%u txs (%.1f%%)\n", nCached, (unsigned int)vPrevouts.size(), vPrevouts.empty() ? 100.0 : 100.0 * nCached / vPrevouts.size());
+    }
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
@@ -4303,9 +4545,14 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // Check transactions
     bool fZerocoinActive = block.GetVersion() >= CBlockHeader::VERSION5;
+
+    // Zerocoin spend proofs are independent of each other, collect them for the check queue
+    bool fZerocoinCheckQueue = fZerocoinActive && nScriptCheckThreads;
+    std::vector<CZerocoinSpendCheck> vZerocoinChecks;
+
     vector<CBigNum> vBlockSerials;
     for (const CTransaction& tx : block.vtx) {
-        if (!CheckTransaction(tx, fZerocoinActive, state))
+        if (!CheckTransaction(tx, fZerocoinActive, state, fZerocoinCheckQueue ? &vZerocoinChecks : NULL))
             return error("CheckBlock() : CheckTransaction failed");
 
         // double check that there are no double spent zOPCX spends in this block
@@ -4333,6 +4580,16 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
             REJECT_INVALID, "bad-blk-sigops", true);
 
+    if (!vZerocoinChecks.empty()) {
+        // CheckTransaction takes cs_main, so the queue is only locked once the checks are collected
+        LOCK(cs_zerocoinspendcheckqueue);
+        CCheckQueueControl<CZerocoinSpendCheck> zerocoinControl(&zerocoinspendcheckqueue);
+        zerocoinControl.Add(vZerocoinChecks);
+        if (!zerocoinControl.Wait())
+            return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"),
+                REJECT_INVALID, "bad-zerocoinspend");
+    }
+
     return true;
 }
 
@@ -4882,6 +5139,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
+        LOCK(cs_main);
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
             pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
@@ -4928,6 +5186,9 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         }
         return error("%s : AcceptBlock FAILED", __func__);
     }
+    // Warm the coins cache while the block waits to be connected
+    if (pindex && pindex->pprev == chainActive.Tip())
+        PrefetchBlockInputs(*pblock);
     // END_LOCK(cs_main); // previous, revisit
 
     if (!ActivateBestChain(state, pblock, checked))
@@ -5070,7 +5331,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(string& strError)
 {
-    if (!pblocktree->LoadBlockIndexGuts())
+    if (!pblocktree->LoadBlockIndexGuts(GetBoolArg("-checkblockhashes", DEFAULT_CHECKBLOCKHASHES)))
         return false;
 
     boost::this_thread::interruption_point();
@@ -5224,7 +5485,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -5267,6 +5528,7 @@ void UnloadBlockIndex()
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
+    ResetStakeModifierIndex();
 }
 
 bool LoadBlockIndex(string& strError)
@@ -5637,8 +5899,10 @@ bool static AlreadyHave(const CInv& inv)
                mapTxLockReqRejected.count(inv.hash);
     case MSG_TXLOCK_VOTE:
         return mapTxLockVote.count(inv.hash);
-    case MSG_SPORK:
+    case MSG_SPORK: {
+        LOCK(cs_mapSporks);
         return mapSporks.count(inv.hash);
+    }
     case MSG_MASTERNODE_WINNER:
         if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
@@ -5683,6 +5947,19 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
+//! The block message sent last, so that a new tip requested by every peer is read and serialized once. Guarded by cs_main.
+static std::pair<uint256, CSerializeDataRef> lastBlockMessage;
+//! Likewise for compact blocks, every peer gets the same short id nonce. Guarded by cs_main.
+static std::pair<uint256, CSerializeDataRef> lastCompactBlockMessage;
+//! Guarded by cs_main.
+static CCompactBlockStats compactBlockStats;
+
+void GetCompactBlockStats(CCompactBlockStats& statsOut)
+{
+    LOCK(cs_main);
+    statsOut = compactBlockStats;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -5705,7 +5982,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end()) {
@@ -5725,14 +6002,31 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    if (inv.type == MSG_CMPCT_BLOCK && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                        if (lastCompactBlockMessage.first != inv.hash) {
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second))
+                                assert(!"cannot load block from disk");
+                            lastCompactBlockMessage = std::make_pair(inv.hash, MakeSharedMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block)));
+                        }
+                        pfrom->PushSharedMessage(lastCompactBlockMessage.second);
+                        compactBlockStats.nSent++;
+                    } else if (inv.type == MSG_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
+                        // Send block from disk, serialized once for all the peers asking for it.
+                        // Blocks too old to be relayed are sent in full when asked for as compact blocks.
+                        if (lastBlockMessage.first != inv.hash) {
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second))
+                                assert(!"cannot load block from disk");
+                            lastBlockMessage = std::make_pair(inv.hash, MakeSharedMessage("block", block));
+                        }
+                        pfrom->PushSharedMessage(lastBlockMessage.second);
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -5768,9 +6062,9 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSerializeDataRef>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushSharedMessage((*mi).second);
                         pushed = true;
                     }
                 }
@@ -5804,13 +6098,18 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
-                        pushed = true;
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_mapSporks);
+                        std::map<uint256, CSporkMessage>::const_iterator mi = mapSporks.find(inv.hash);
+                        if (mi != mapSporks.end()) {
+                            ss.reserve(1000);
+                            ss << mi->second;
+                            pushed = true;
+                        }
                     }
+                    if (pushed)
+                        pfrom->PushMessage("spork", ss);
                 }
                 if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
                     if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
@@ -5901,7 +6200,7 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -5921,7 +6220,44 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
-bool fRequestedSporksIDB = false;
+std::atomic<bool> fRequestedSporksIDB(false);
+
+/** Validate and store a block received from pfrom whose parent we know */
+static void ProcessReceivedBlock(CNode* pfrom, CBlock& block, const std::string& strCommand)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    // Try to process all blocks that we don't have
+    bool fProcessed = false;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator pindex = mapBlockIndex.find(inv.hash);
+        if (pindex != mapBlockIndex.end() && 0 != (pindex->second->nStatus & BLOCK_HAVE_DATA) && pindex->second->nHeight <= chainActive.Height()) {
+            LogPrint("net", "%s : Already processed block (%d) %s, skipping ProcessNewBlock()\n", __func__, pindex->second->nHeight, inv.hash.GetHex());
+            fProcessed = true;
+        }
+    }
+    if (!fProcessed) {
+        // Without cs_main, so that CheckBlock runs in parallel with the messages of other peers
+        CValidationState state;
+        ProcessNewBlock(state, pfrom, &block);
+
+        int nDoS;
+        if(state.IsInvalid(nDoS)) {
+            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+            if(nDoS > 0) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+    }
+
+    //disconnect this node if its old protocol version
+    pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -5936,6 +6272,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         // Each connection can only send one version message
         if (pfrom->nVersion != 0) {
             pfrom->PushMessage("reject", strCommand, REJECT_DUPLICATE, string("Duplicate version message"));
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 1);
             return false;
         }
@@ -5946,10 +6283,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 !pSporkDB->SporkExists(SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2) &&
                 !pSporkDB->SporkExists(SPORK_20_ZEROCOIN_MAINTENANCE_MODE);
 
-        if (fMissingSporks || !fRequestedSporksIDB){
+        bool fRequestedSporks = fRequestedSporksIDB.exchange(true);
+        if (fMissingSporks || !fRequestedSporks){
             LogPrintf("asking peer for sporks\n");
             pfrom->PushMessage("getsporks");
-            fRequestedSporksIDB = true;
         }
 
         int64_t nTime;
@@ -5994,7 +6331,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
 
         // Potentially mark this peer as a preferred download peer.
-        UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        {
+            LOCK(cs_main);
+            UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        }
 
         // Change version
         pfrom->PushMessage("verack");
@@ -6053,6 +6393,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (pfrom->nVersion == 0) {
         // Must have a version message before anything else
+        LOCK(cs_main);
         Misbehaving(pfrom->GetId(), 1);
         return false;
     }
@@ -6074,6 +6415,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             // nodes)
             pfrom->PushMessage("sendheaders");
         }
+
+        if (pfrom->nVersion >= COMPACT_BLOCKS_VERSION && GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS)) {
+            // Tell our peer we can serve compact blocks, we do not want them announced unasked
+            bool fAnnounce = false;
+            uint64_t nCmpctVersion = COMPACT_BLOCKS_ENCODING_VERSION;
+            pfrom->PushMessage("sendcmpct", fAnnounce, nCmpctVersion);
+        }
     }
 
 
@@ -6092,6 +6440,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pfrom->nVersion < CADDR_TIME_VERSION && addrman.size() > 1000)
             return true;
         if (vAddr.size() > 1000) {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("message addr size() = %u", vAddr.size());
         }
@@ -6150,6 +6499,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vector<CInv> vInv;
         vRecv >> vInv;
         if (vInv.size() > MAX_INV_SZ) {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("message inv size() = %u", vInv.size());
         }
@@ -6192,6 +6542,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 return error("send buffer size() = %u", pfrom->nSendSize);
             }
         }
+
+        // Most transactions of a single new block are in our mempool already
+        CNodeState* nodestate = State(pfrom->GetId());
+        if (vToFetch.size() == 1 && nodestate->fSupportsCompactBlocks) {
+            vToFetch[0].type = MSG_CMPCT_BLOCK;
+            nodestate->setCompactBlocksRequested.insert(vToFetch[0].hash);
+        }
         }
 
         if (!vToFetch.empty())
@@ -6203,6 +6560,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vector<CInv> vInv;
         vRecv >> vInv;
         if (vInv.size() > MAX_INV_SZ) {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("message getdata size() = %u", vInv.size());
         }
@@ -6309,6 +6667,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vector<unsigned char> vchSig;
         int64_t sigTime;
 
+        // mapObfuscationBroadcastTxes is read under cs_main too
+        LOCK(cs_main);
+
         if (strCommand == "tx") {
             vRecv >> tx;
         } else if (strCommand == "dstx") {
@@ -6352,8 +6713,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
         bool fMissingInputs = false;
         bool fMissingZerocoinInputs = false;
         CValidationState state;
@@ -6463,6 +6822,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
         unsigned int nCount = ReadCompactSize(vRecv);
         if (nCount > MAX_HEADERS_RESULTS) {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("headers message size = %u", nCount);
         }
@@ -6548,6 +6908,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     LogPrint("net", "Requesting block %s from  peer=%d\n",
                             pindex->GetBlockHash().ToString(), pfrom->id);
                 }
+                if (vGetData.size() == 1 && nodestate && nodestate->fSupportsCompactBlocks && pindexLast->pprev == chainActive.Tip()) {
+                    // A single new block on our tip, most of its transactions are in our mempool already
+                    vGetData[0].type = MSG_CMPCT_BLOCK;
+                    nodestate->setCompactBlocksRequested.insert(vGetData[0].hash);
+                }
                 if (vGetData.size() > 1) {
                     LogPrint("net", "Downloading blocks toward %s (%d) via headers direct fetch\n",
                             pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
@@ -6570,41 +6935,167 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
-            if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
-                //we already asked for this block, so lets work backwards and ask for the previous block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
-                pfrom->vBlockRequested.push_back(block.hashPrevBlock);
-            } else {
-                //ask to sync to this block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
-                pfrom->vBlockRequested.push_back(hashBlock);
+        {
+            LOCK(cs_main);
+            if (!mapBlockIndex.count(block.hashPrevBlock)) {
+                if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
+                    //we already asked for this block, so lets work backwards and ask for the previous block
+                    pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
+                    pfrom->vBlockRequested.push_back(block.hashPrevBlock);
+                } else {
+                    //ask to sync to this block
+                    pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
+                    pfrom->vBlockRequested.push_back(hashBlock);
+                }
+                return true;
             }
-        } else {
-            pfrom->AddInventoryKnown(inv);
+        }
+        ProcessReceivedBlock(pfrom, block, strCommand);
+    }
 
-            // Try to process all blocks that we don't have
-            BlockMap::const_iterator pindex = mapBlockIndex.find(block.GetHash());
-            if (pindex != mapBlockIndex.end() && 0 != (pindex->second->nStatus & BLOCK_HAVE_DATA) && pindex->second->nHeight <= chainActive.Height()) {
-                LogPrint("net", "%s : Already processed block (%d) %s, skipping ProcessNewBlock()\n", __func__, pindex->second->nHeight, block.GetHash().GetHex());
-            } else {
-                CValidationState state;
-                ProcessNewBlock(state, pfrom, &block);
 
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
-                }
+    else if (strCommand == "sendcmpct") {
+        bool fAnnounce;
+        uint64_t nCmpctVersion;
+        vRecv >> fAnnounce >> nCmpctVersion;
+        // Blocks are always requested after an inv or headers announcement, fAnnounce is not supported
+        if (nCmpctVersion == COMPACT_BLOCKS_ENCODING_VERSION && GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS)) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fSupportsCompactBlocks = true;
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("net", "received compact block %s (%u txs) peer=%d\n", hashBlock.ToString(), cmpctblock.BlockTxCount(), pfrom->id);
+
+        // Reconstructed blocks are processed without cs_main
+        CBlock block;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            // Reconstruction walks the whole mempool, only do it for blocks we asked for
+            if (!nodestate->setCompactBlocksRequested.erase(hashBlock)) {
+                LogPrint("net", "ignoring unrequested compact block %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+                return true;
+            }
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+            compactBlockStats.nReceived++;
+
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                return true;
+
+            boost::shared_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock());
+            ReadStatus status = READ_STATUS_FAILED;
+            // Leave blocks that do not connect to the full block path, which asks for the missing ancestors
+            if (mapBlockIndex.count(cmpctblock.header.hashPrevBlock))
+                status = partialBlock->InitData(cmpctblock, mempool);
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid compact block %s from peer=%d", hashBlock.ToString(), pfrom->id);
+            }
+            if (status == READ_STATUS_FAILED) {
+                compactBlockStats.nFailed++;
+                vector<CInv> vGetData(1, CInv(MSG_BLOCK, hashBlock));
+                pfrom->PushMessage("getdata", vGetData);
+                return true;
+            }
+            compactBlockStats.nTxPrefilled += partialBlock->GetPrefilledCount();
+            compactBlockStats.nTxFromMempool += partialBlock->GetMempoolCount();
+
+            BlockTransactionsRequest req;
+            req.blockhash = hashBlock;
+            partialBlock->GetMissing(req.indexes);
+            if (!req.indexes.empty()) {
+                compactBlockStats.nRoundTrips++;
+                compactBlockStats.nTxRequested += req.indexes.size();
+                nodestate->partialBlock = partialBlock;
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+
+            if (partialBlock->FillBlock(block, std::vector<CTransaction>()) != READ_STATUS_OK) {
+                compactBlockStats.nFailed++;
+                vector<CInv> vGetData(1, CInv(MSG_BLOCK, hashBlock));
+                pfrom->PushMessage("getdata", vGetData);
+                return true;
+            }
+            compactBlockStats.nReconstructed++;
+        }
+        ProcessReceivedBlock(pfrom, block, strCommand);
+    }
+
+
+    else if (strCommand == "getblocktxn") {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer=%d asked for transactions of unknown block %s\n", pfrom->id, req.blockhash.ToString());
+            return true;
+        }
+        if (mi->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // Not a relay round trip, answer as a getdata for the full block
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, mi->second))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp;
+        resp.blockhash = req.blockhash;
+        resp.txn.reserve(req.indexes.size());
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("getblocktxn with out of bounds index from peer=%d", pfrom->id);
+            }
+            resp.txn.push_back(block.vtx[req.indexes[i]]);
+        }
+        compactBlockStats.nTxSent += resp.txn.size();
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            boost::shared_ptr<PartiallyDownloadedBlock> partialBlock = nodestate->partialBlock;
+            if (!partialBlock || partialBlock->GetBlockHash() != resp.blockhash) {
+                LogPrint("net", "ignoring unrequested blocktxn for %s peer=%d\n", resp.blockhash.ToString(), pfrom->id);
+                return true;
             }
+            nodestate->partialBlock.reset();
 
-            //disconnect this node if its old protocol version
-            pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+            ReadStatus status = partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid blocktxn for %s from peer=%d", resp.blockhash.ToString(), pfrom->id);
+            }
+            if (status == READ_STATUS_FAILED) {
+                compactBlockStats.nFailed++;
+                vector<CInv> vGetData(1, CInv(MSG_BLOCK, resp.blockhash));
+                pfrom->PushMessage("getdata", vGetData);
+                return true;
+            }
         }
+        ProcessReceivedBlock(pfrom, block, strCommand);
     }
 
 
@@ -6742,6 +7233,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 // This isn't a Misbehaving(100) (immediate ban) because the
                 // peer might be an older or different implementation with
                 // a different signature key, etc.
+                LOCK(cs_main);
                 Misbehaving(pfrom->GetId(), 10);
             }
         }
@@ -6752,6 +7244,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                  strCommand == "filteradd" ||
                  strCommand == "filterclear")) {
         LogPrintf("bloom message=%s\n", strCommand);
+        LOCK(cs_main);
         Misbehaving(pfrom->GetId(), 100);
     }
 
@@ -6759,10 +7252,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CBloomFilter filter;
         vRecv >> filter;
 
-        if (!filter.IsWithinSizeConstraints())
+        if (!filter.IsWithinSizeConstraints()) {
             // There is no excuse for sending a too-large filter
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 100);
-        else {
+        } else {
             LOCK(pfrom->cs_filter);
             delete pfrom->pfilter;
             pfrom->pfilter = new CBloomFilter(filter);
@@ -6778,14 +7272,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
         // and thus, the maximum size any matched object can have) in a filteradd message
-        if (vData.size() > MAX_SCRIPT_ELEMENT_SIZE) {
-            Misbehaving(pfrom->GetId(), 100);
-        } else {
+        bool fMisbehaving = vData.size() > MAX_SCRIPT_ELEMENT_SIZE;
+        if (!fMisbehaving) {
             LOCK(pfrom->cs_filter);
             if (pfrom->pfilter)
                 pfrom->pfilter->insert(vData);
             else
-                Misbehaving(pfrom->GetId(), 100);
+                fMisbehaving = true;
+        }
+        // cs_main goes before cs_filter
+        if (fMisbehaving) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
         }
     }
 
@@ -6822,13 +7320,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
     } else {
         //probably one the extensions
-        obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
         mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
         budget.ProcessMessage(pfrom, strCommand, vRecv);
         masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
         ProcessSpork(pfrom, strCommand, vRecv);
-        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        {
+            // The obfuscation pool, the SwiftX lock maps and the sync counters have no locks of their own,
+            // cs_main keeps these handlers from running on several message threads at once
+            LOCK(cs_main);
+            obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
+            ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
+            masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        }
     }
 
 
@@ -6927,6 +7430,7 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        int64_t nTimeStart = GetTimeMicros();
         try {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
             boost::this_thread::interruption_point();
@@ -6949,6 +7453,9 @@ bool ProcessMessages(CNode* pfrom)
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        int64_t nTimeEnd = GetTimeMicros();
+        RecordMessageStats(strCommand, nTimeStart - msg.nTime, nTimeEnd - nTimeStart, pfrom->vRecvMsg.end() - it);
+
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
 
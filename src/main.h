@@ -40,15 +40,19 @@
 #include <utility>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
 class CZerocoinDB;
 class CSporkDB;
 class CBlockTreeDB;
+class CCoinsViewAsyncFlush;
 class CBloomFilter;
+class CCheckQueueHost;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -106,6 +110,8 @@ static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 
 /** Enable bloom filter */
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+/** Default for -compactblocks, ask peers for new blocks as compact blocks */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
 
 /** Default for -blockspamfilter, use header spam filter */
 static const bool DEFAULT_BLOCK_SPAM_FILTER = true;
@@ -145,10 +151,12 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+/** The -par worker threads, shared by all check queues */
+extern CCheckQueueHost checkqueuehost;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
-extern unsigned int nCoinCacheSize;
+extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern bool fVerifyingBlocks;
@@ -227,7 +235,7 @@ bool ProcessMessages(CNode* pfrom);
  */
 bool AddressRefreshBroadcast();
 bool SendMessages(CNode* pto, bool fSendTrickle);
-/** Run an instance of the script checking thread */
+/** Run an instance of the verification thread, shared by the script checks and the other check queues */
 void ThreadScriptCheck();
 
 // ***TODO*** probably not the right place for these 2
@@ -287,6 +295,23 @@ struct CNodeStateStats {
     std::vector<int> vHeightInFlight;
 };
 
+struct CCompactBlockStats {
+    uint64_t nReceived;
+    uint64_t nReconstructed; //!< completed from the mempool without a round trip
+    uint64_t nRoundTrips;    //!< completed after a getblocktxn request
+    uint64_t nFailed;        //!< fetched in full after all, e.g. on a short id collision
+    uint64_t nTxPrefilled;
+    uint64_t nTxFromMempool;
+    uint64_t nTxRequested;
+    uint64_t nSent;
+    uint64_t nTxSent;        //!< sent in reply to getblocktxn
+
+    CCompactBlockStats() : nReceived(0), nReconstructed(0), nRoundTrips(0), nFailed(0), nTxPrefilled(0), nTxFromMempool(0), nTxRequested(0), nSent(0), nTxSent(0) {}
+};
+
+/** Compact block relay counters since startup */
+void GetCompactBlockStats(CCompactBlockStats& statsOut);
+
 struct CDiskTxPos : public CDiskBlockPos {
     unsigned int nTxOffset; // after header
 
@@ -435,6 +460,35 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the verification of one zerocoin spend proof
+ * (accumulator proof of knowledge and serial number signature).
+ * The spend is shared so that moving checks between queues stays cheap.
+ */
+class CZerocoinSpendCheck
+{
+private:
+    boost::shared_ptr<const libzerocoin::CoinSpend> pspend;
+    CBigNum bnAccumulatorValue;
+    uint256 txid;
+    uint256 hashSpend;
+
+public:
+    CZerocoinSpendCheck() : bnAccumulatorValue(0) {}
+    CZerocoinSpendCheck(const libzerocoin::CoinSpend& spendIn, const CBigNum& bnAccumulatorValueIn, const uint256& txidIn, const uint256& hashSpendIn) : pspend(new libzerocoin::CoinSpend(spendIn)),
+                                                                                                                                                       bnAccumulatorValue(bnAccumulatorValueIn), txid(txidIn), hashSpend(hashSpendIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        pspend.swap(check.pspend);
+        std::swap(bnAccumulatorValue, check.bnAccumulatorValue);
+        std::swap(txid, check.txid);
+        std::swap(hashSpend, check.hashSpend);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
@@ -628,6 +682,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Global variable that points to the background writer below pcoinsTip, NULL if there is none */
+extern CCoinsViewAsyncFlush* pcoinsFlush;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
@@ -661,14 +718,17 @@ protected:
 */
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state);
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks = NULL);
 bool ContextualCheckCoinSpend(const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& txid, bool fSkipSerialCheck = false);
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 bool BlockToPubcoinList(const CBlock& block, list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid);
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid);
+bool BlockToMintIndex(const CBlock& block, std::vector<CZerocoinBlockMintTx>& vMintTxs);
+/** Mints of a connected block from the mint index of zerocoinDB, reading the block from disk only if it is not indexed */
+bool GetBlockMints(const CBlockIndex* pindex, std::list<CZerocoinMint>& listMints, bool fFilterInvalid);
 bool BlockToMintValueVector(const CBlock& block, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues);
 std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock& block, bool fFilterInvalid);
 void FindMints(vector<CZerocoinMint> vMintsToFind, vector<CZerocoinMint>& vMintsToUpdate, vector<CZerocoinMint>& vMissingMints, bool fExtendedSearch);
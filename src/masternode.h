@@ -191,6 +191,8 @@ public:
     }
 
     uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0);
+    //! Score of the masternode with input vin for the block hash returned by GetBlockHash
+    static uint256 CalculateScore(const CTxIn& vin, const uint256& hash);
 
     ADD_SERIALIZE_METHODS;
 
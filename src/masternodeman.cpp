@@ -34,6 +34,14 @@ struct CompareScoreTxIn {
     }
 };
 
+struct CompareScoreIndex {
+    bool operator()(const pair<int64_t, size_t>& t1,
+        const pair<int64_t, size_t>& t2) const
+    {
+        return t1.first < t2.first;
+    }
+};
+
 struct CompareScoreMN {
     bool operator()(const pair<int64_t, CMasternode>& t1,
         const pair<int64_t, CMasternode>& t2) const
@@ -209,6 +217,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        mapRankingCache.clear();
         return true;
     }
 
@@ -286,6 +295,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            mapRankingCache.clear();
         } else {
             ++it;
         }
@@ -347,6 +357,9 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapScoreCache.clear();
+    dequeScoreBlocks.clear();
+    mapRankingCache.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -574,79 +587,122 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     return NULL;
 }
 
-CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
+const std::map<COutPoint, int64_t>& CMasternodeMan::GetScores(const uint256& hash)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
-
-        // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
+    std::map<uint256, std::map<COutPoint, int64_t> >::iterator it = mapScoreCache.find(hash);
+    if (it == mapScoreCache.end()) {
+        if (dequeScoreBlocks.size() >= MASTERNODE_SCORE_CACHE_BLOCKS) {
+            const uint256& hashOldest = dequeScoreBlocks.front();
+            std::map<pair<uint256, pair<int, int> >, CMasternodeRanking>::iterator itRanking = mapRankingCache.lower_bound(make_pair(hashOldest, make_pair(INT_MIN, INT_MIN)));
+            while (itRanking != mapRankingCache.end() && itRanking->first.first == hashOldest)
+                mapRankingCache.erase(itRanking++);
+            mapScoreCache.erase(hashOldest);
+            dequeScoreBlocks.pop_front();
         }
+        it = mapScoreCache.insert(make_pair(hash, std::map<COutPoint, int64_t>())).first;
+        dequeScoreBlocks.push_back(hash);
     }
+    std::map<COutPoint, int64_t>& mapScores = it->second;
 
-    return winner;
+    // Only masternodes that joined since the last call are scored, a new block hash scores the whole list once
+    BOOST_FOREACH (const CMasternode& mn, vMasternodes) {
+        if (!mapScores.count(mn.vin.prevout))
+            mapScores[mn.vin.prevout] = CMasternode::CalculateScore(mn.vin, hash).GetCompact(false);
+    }
+
+    return mapScores;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+const CMasternodeMan::CMasternodeRanking& CMasternodeMan::GetRanking(const uint256& hash, int minProtocol, int nFilter)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMasternode_Age = 0;
+    int64_t nNow = GetAdjustedTime();
+    CMasternodeRanking& ranking = mapRankingCache[make_pair(hash, make_pair(minProtocol, nFilter))];
+    if (ranking.nTimeExpires > nNow)
+        return ranking;
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    const std::map<COutPoint, int64_t>& mapScores = GetScores(hash);
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    ranking.vScores.clear();
+    ranking.mapRanks.clear();
+    ranking.nWinner = -1;
+    ranking.nTimeExpires = nNow + MASTERNODE_CHECK_SECONDS;
+
+    int64_t nWinnerScore = 0;
+    for (size_t i = 0; i < vMasternodes.size(); i++) {
+        CMasternode& mn = vMasternodes[i];
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
         }
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMasternode_Age) < nMasternode_Min_Age) {
+        if (nFilter & RANKING_MINIMUM_AGE) {
+            int64_t nMasternode_Age = nNow - mn.sigTime;
+            if (nMasternode_Age < MN_WINNER_MINIMUM_AGE) {
                 if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
+                ranking.nTimeExpires = std::min(ranking.nTimeExpires, mn.sigTime + MN_WINNER_MINIMUM_AGE);
                 continue;                                                   // Skip masternodes younger than (default) 1 hour
             }
         }
-        if (fOnlyActive) {
+        if (nFilter & RANKING_ONLY_ACTIVE) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+        int64_t n2 = mapScores.find(mn.vin.prevout)->second;
+        ranking.vScores.push_back(make_pair(n2, i));
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
+        // the first masternode with the highest non-zero score wins the block
+        if (n2 > nWinnerScore) {
+            nWinnerScore = n2;
+            ranking.nWinner = i;
         }
     }
 
-    return -1;
+    sort(ranking.vScores.rbegin(), ranking.vScores.rend(), CompareScoreIndex());
+
+    for (size_t i = 0; i < ranking.vScores.size(); i++)
+        ranking.mapRanks.insert(make_pair(vMasternodes[ranking.vScores[i].second].vin.prevout, (int)i + 1));
+
+    return ranking;
+}
+
+CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
+{
+    LOCK(cs);
+
+    uint256 hash = 0;
+    if (!GetBlockHash(hash, nBlockHeight)) return NULL;
+
+    // scan for winner
+    const CMasternodeRanking& ranking = GetRanking(hash, minProtocol, RANKING_ONLY_ACTIVE);
+    if (ranking.nWinner < 0) return NULL;
+
+    return &vMasternodes[ranking.nWinner];
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    //make sure we know about this block
+    uint256 hash = 0;
+    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+
+    int nFilter = fOnlyActive ? RANKING_ONLY_ACTIVE : 0;
+    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT))
+        nFilter |= RANKING_MINIMUM_AGE;
+
+    const CMasternodeRanking& ranking = GetRanking(hash, minProtocol, nFilter);
+    std::map<COutPoint, int>::const_iterator it = ranking.mapRanks.find(vin.prevout);
+    if (it == ranking.mapRanks.end()) return -1;
+
+    return it->second;
 }
 
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
+    LOCK(cs);
+
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
     std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
@@ -654,6 +710,8 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
+    const std::map<COutPoint, int64_t>& mapScores = GetScores(hash);
+
     // scan for winner
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
         mn.Check();
@@ -665,8 +723,7 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+        int64_t n2 = mapScores.find(mn.vin.prevout)->second;
 
         vecMasternodeScores.push_back(make_pair(n2, mn));
     }
@@ -684,33 +741,15 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    LOCK(cs);
 
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
+    uint256 hash = 0;
+    if (!GetBlockHash(hash, nBlockHeight)) return NULL;
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    const CMasternodeRanking& ranking = GetRanking(hash, minProtocol, fOnlyActive ? RANKING_ONLY_ACTIVE : 0);
+    if (nRank < 1 || nRank > (int)ranking.vScores.size()) return NULL;
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
-
-    return NULL;
+    return &vMasternodes[ranking.vScores[nRank - 1].second];
 }
 
 void CMasternodeMan::ProcessMasternodeConnections()
@@ -1152,6 +1191,7 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            mapRankingCache.clear();
             break;
         }
         ++it;
@@ -1173,6 +1213,7 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
             masternodeSync.AddedMasternodeList(mnb.GetHash());
         }
     } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        mapRankingCache.clear();
         masternodeSync.AddedMasternodeList(mnb.GetHash());
     }
 }
@@ -14,9 +14,14 @@
 #include "sync.h"
 #include "util.h"
 
+#include <deque>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
+//! number of blocks whose masternode scores are kept in memory
+static const unsigned int MASTERNODE_SCORE_CACHE_BLOCKS = 16;
+
 using namespace std;
 
 class CMasternodeMan;
@@ -66,6 +71,37 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    /**
+     * Masternodes that pass one filter, sorted by their score for one block
+     * (best first). Entries index vMasternodes, so the ranking cache is
+     * dropped whenever the vector changes. A ranking also expires after
+     * MASTERNODE_CHECK_SECONDS, the interval at which the state of a
+     * masternode is re-checked, or when a filtered out masternode becomes
+     * old enough to be ranked.
+     */
+    struct CMasternodeRanking {
+        std::vector<pair<int64_t, size_t> > vScores;
+        std::map<COutPoint, int> mapRanks; // 1-based
+        int nWinner;                        // GetCurrentMasterNode, -1 if none
+        int64_t nTimeExpires;
+
+        CMasternodeRanking() : nWinner(-1), nTimeExpires(0) {}
+    };
+    enum RankingFilter {
+        RANKING_ONLY_ACTIVE = 1,
+        RANKING_MINIMUM_AGE = 2
+    };
+    // compact scores per GetBlockHash hash and masternode, oldest block first in dequeScoreBlocks
+    std::map<uint256, std::map<COutPoint, int64_t> > mapScoreCache;
+    std::deque<uint256> dequeScoreBlocks;
+    // rankings by block hash, minimum protocol and RankingFilter flags
+    std::map<pair<uint256, pair<int, int> >, CMasternodeRanking> mapRankingCache;
+
+    /// Scores of every masternode in the list for the block hash, computing the missing ones
+    const std::map<COutPoint, int64_t>& GetScores(const uint256& hash);
+    /// Cached ranking for the block hash, rebuilt when it expired
+    const CMasternodeRanking& GetRanking(const uint256& hash, int minProtocol, int nFilter);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -89,6 +125,9 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+
+        if (ser_action.ForRead())
+            mapRankingCache.clear();
     }
 
     CMasternodeMan();
@@ -28,6 +28,11 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -86,6 +91,13 @@ static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
+static bool fSocketEventsEpoll = false;
+#ifdef HAVE_EPOLL
+//! epoll instance of ThreadSocketHandler in epoll mode
+static int hEpoll = -1;
+//! self-pipe that interrupts epoll_wait, see WakeupSocketHandler
+static int hWakeupPipe[2] = {-1, -1};
+#endif
 CAddrMan addrman;
 int nMaxConnections = 125;
 int MAX_OUTBOUND_CONNECTIONS = 16;
@@ -93,7 +105,7 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSerializeDataRef> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -111,7 +123,16 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore* semOutbound = NULL;
-boost::condition_variable messageHandlerCondition;
+
+//! Peers waiting for a message handler thread, with their fSendTrickle, see ThreadMessageHandler
+static std::deque<std::pair<CNode*, bool> > queueMessageWork;
+static boost::mutex mutexMessageWork;
+static boost::condition_variable condMessageWork;
+static uint64_t vMessageWorkDepth[MESSAGE_STATS_BUCKETS];
+static int nMessageHandlerThreads = 0;
+
+static std::map<std::string, CMessageStats> mapMessageStats;
+static CCriticalSection cs_mapMessageStats;
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -431,7 +452,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!fSocketEventsEpoll && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -447,6 +468,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
         }
+        WakeupSocketHandler();
 
         pnode->nTimeConnected = GetTime();
         if (obfuScationMaster) pnode->fObfuScationMaster = true;
@@ -722,9 +744,76 @@ void CNode::copyStats(CNodeStats& stats)
 }
 #undef X
 
+/** Hand pnode to the message handler threads, unless it is already waiting for or being processed by one */
+static void QueueMessageWork(CNode* pnode, bool fSendTrickle)
+{
+    {
+        LOCK(cs_vNodes);
+        pnode->AddRef();
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(mutexMessageWork);
+        if (!pnode->fMessageWorkQueued) {
+            pnode->fMessageWorkQueued = true;
+            queueMessageWork.push_back(std::make_pair(pnode, fSendTrickle));
+            condMessageWork.notify_one();
+            return;
+        }
+    }
+    LOCK(cs_vNodes);
+    pnode->Release();
+}
+
+CMessageStats::CMessageStats() : nCount(0), nTotalWait(0), nTotalTime(0)
+{
+    for (unsigned int i = 0; i < MESSAGE_STATS_BUCKETS; i++)
+        vWait[i] = vTime[i] = vDepth[i] = 0;
+}
+
+unsigned int MessageStatsBucket(int64_t nValue, bool fDepth)
+{
+    unsigned int nBucket = 0;
+    for (int64_t nBound = fDepth ? 1 : 100; nValue >= nBound && nBucket < MESSAGE_STATS_BUCKETS - 1; nBound *= fDepth ? 2 : 10)
+        nBucket++;
+    return nBucket;
+}
+
+void RecordMessageStats(const std::string& strCommand, int64_t nWait, int64_t nTime, size_t nDepth)
+{
+    LOCK(cs_mapMessageStats);
+    // Commands come from the peers, do not let them grow the map without bound
+    std::map<std::string, CMessageStats>::iterator it = mapMessageStats.find(strCommand);
+    if (it == mapMessageStats.end())
+        it = mapMessageStats.insert(std::make_pair(mapMessageStats.size() < MAX_MESSAGE_STATS_TYPES ? strCommand : "other", CMessageStats())).first;
+
+    CMessageStats& stats = it->second;
+    stats.nCount++;
+    stats.nTotalWait += nWait;
+    stats.nTotalTime += nTime;
+    stats.vWait[MessageStatsBucket(nWait, false)]++;
+    stats.vTime[MessageStatsBucket(nTime, false)]++;
+    stats.vDepth[MessageStatsBucket(nDepth, true)]++;
+}
+
+void GetMessageStats(std::map<std::string, CMessageStats>& mapStatsOut, std::vector<uint64_t>& vWorkQueueOut)
+{
+    {
+        LOCK(cs_mapMessageStats);
+        mapStatsOut = mapMessageStats;
+    }
+    boost::unique_lock<boost::mutex> lock(mutexMessageWork);
+    vWorkQueueOut.assign(vMessageWorkDepth, vMessageWorkDepth + MESSAGE_STATS_BUCKETS);
+}
+
+int GetMessageHandlerThreads()
+{
+    return nMessageHandlerThreads;
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 {
+    bool fComplete = false;
     while (nBytes > 0) {
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
@@ -753,10 +842,13 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            fComplete = true;
         }
     }
 
+    if (fComplete)
+        QueueMessageWork(this, fWhitelisted);
+
     return true;
 }
 
@@ -790,17 +882,89 @@ int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
     return nCopy;
 }
 
+//! Data buffers are grown up to this far ahead of the received data
+static const unsigned int RECV_BUFFER_AHEAD = 256 * 1024;
+
+static std::deque<CSerializeData> vRecvBufferPool[RECV_BUFFER_CLASSES];
+static CCriticalSection cs_vRecvBufferPool;
+
+//! Smallest size class with room for nSize bytes, RECV_BUFFER_CLASSES if there is none
+static unsigned int GetRecvBufferClass(size_t nSize)
+{
+    unsigned int nClass = 0;
+    while (nClass < RECV_BUFFER_CLASSES && (RECV_BUFFER_MIN_SIZE << nClass) < nSize)
+        nClass++;
+    return nClass;
+}
+
+void AcquireRecvBuffer(size_t nSize, CSerializeData& vchOut)
+{
+    unsigned int nClass = GetRecvBufferClass(nSize);
+    if (nClass < RECV_BUFFER_CLASSES) {
+        {
+            LOCK(cs_vRecvBufferPool);
+            std::deque<CSerializeData>& vPool = vRecvBufferPool[nClass];
+            if (!vPool.empty()) {
+                vchOut.swap(vPool.back());
+                vPool.pop_back();
+                return;
+            }
+        }
+        nSize = RECV_BUFFER_MIN_SIZE << nClass;
+    }
+    CSerializeData vchNew;
+    vchNew.reserve(nSize);
+    vchOut.swap(vchNew);
+}
+
+void ReleaseRecvBuffer(CSerializeData& vch)
+{
+    if (vch.capacity() < RECV_BUFFER_MIN_SIZE)
+        return;
+    unsigned int nClass = 0;
+    while (nClass + 1 < RECV_BUFFER_CLASSES && (RECV_BUFFER_MIN_SIZE << (nClass + 1)) <= vch.capacity())
+        nClass++;
+    vch.clear();
+
+    LOCK(cs_vRecvBufferPool);
+    std::deque<CSerializeData>& vPool = vRecvBufferPool[nClass];
+    if (vPool.size() * (RECV_BUFFER_MIN_SIZE << nClass) >= RECV_BUFFER_POOL_CLASS_BYTES && !vPool.empty())
+        return;
+    vPool.push_back(CSerializeData());
+    vPool.back().swap(vch);
+}
+
+size_t GetRecvBufferPoolCount(size_t nSize)
+{
+    unsigned int nClass = GetRecvBufferClass(nSize);
+    if (nClass == RECV_BUFFER_CLASSES)
+        return 0;
+    LOCK(cs_vRecvBufferPool);
+    return vRecvBufferPool[nClass].size();
+}
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData vch;
+    vRecv.swap(vch);
+    ReleaseRecvBuffer(vch);
+}
+
 int CNetMessage::readData(const char* pch, unsigned int nBytes)
 {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    if (vRecv.capacity() < nDataPos + nCopy) {
+        // Move to a pooled buffer for up to 256 KiB ahead, but never more than the total message size.
+        CSerializeData vch;
+        AcquireRecvBuffer(std::min(hdr.nMessageSize, nDataPos + nCopy + RECV_BUFFER_AHEAD), vch);
+        vch.insert(vch.end(), vRecv.begin(), vRecv.end());
+        vRecv.swap(vch);
+        ReleaseRecvBuffer(vch);
     }
 
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -810,22 +974,49 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializeDataRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
+#ifdef WIN32
+        const CSerializeData& data = **it;
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Gather the queued messages so that a single call sends them all
+        struct iovec vIov[MAX_SEND_IOV];
+        int nIov = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (std::deque<CSerializeDataRef>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV; ++itIov) {
+            const CSerializeData& data = **itIov;
+            vIov[nIov].iov_base = (void*)&data[nOffset];
+            vIov[nIov].iov_len = data.size() - nOffset;
+            nIov++;
+            nOffset = 0;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = vIov;
+        msg.msg_iovlen = nIov;
+        ssize_t nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the messages that went out in full
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                size_t nRemaining = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
+            }
+            if (pnode->nSendOffset > 0) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -852,283 +1043,532 @@ void SocketSendData(CNode* pnode)
 
 static list<CNode*> vNodesDisconnected;
 
-void ThreadSocketHandler()
+//! epoll_event tokens of the wakeup pipe and the listening sockets, nodes use their id
+static const uint64_t EPOLL_TOKEN_WAKEUP = 1ULL << 33;
+static const uint64_t EPOLL_TOKEN_LISTEN = 1ULL << 32; // plus the index in vhListenSocket
+//! Maximum number of events returned by one epoll_wait
+static const int EPOLL_MAX_EVENTS = 1024;
+//! Longest wait in epoll mode while no node has deferred work (milliseconds)
+static const int SOCKET_EVENTS_IDLE_TIMEOUT = 1000;
+//! Frequency to retry nodes whose data could not be moved yet (milliseconds)
+static const int SOCKET_EVENTS_POLL_TIMEOUT = 50;
+
+bool SetSocketEvents(const std::string& strMode)
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true) {
-        //
-        // Disconnect nodes
-        //
-        {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty())) {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+    if (strMode == "select") {
+        fSocketEventsEpoll = false;
+        return true;
+    }
+#ifdef HAVE_EPOLL
+    if (strMode == "epoll") {
+        fSocketEventsEpoll = true;
+        return true;
+    }
+#endif
+    return false;
+}
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+bool IsSocketEventsEpoll()
+{
+    return fSocketEventsEpoll;
+}
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+void WakeupSocketHandler()
+{
+#ifdef HAVE_EPOLL
+    if (hWakeupPipe[1] == -1)
+        return;
+    // The pipe is non-blocking, if it is full the handler is already woken up
+    char c = 0;
+    ssize_t nWritten = write(hWakeupPipe[1], &c, 1);
+    (void)nWritten;
+#endif
+}
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+#ifdef HAVE_EPOLL
+void CloseSocketEvents()
+{
+    if (hEpoll != -1)
+        close(hEpoll);
+    for (int i = 0; i < 2; i++) {
+        if (hWakeupPipe[i] != -1)
+            close(hWakeupPipe[i]);
+        hWakeupPipe[i] = -1;
+    }
+    hEpoll = -1;
+}
+
+bool StartSocketEvents()
+{
+    hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1)
+        return error("%s: epoll_create1 failed: %s", __func__, NetworkErrorString(errno));
+    if (pipe2(hWakeupPipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        hWakeupPipe[0] = hWakeupPipe[1] = -1;
+        CloseSocketEvents();
+        return error("%s: pipe2 failed: %s", __func__, NetworkErrorString(errno));
+    }
+
+    // Level-triggered: the pipe is drained and one connection is accepted per event
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = EPOLL_TOKEN_WAKEUP;
+    bool fSuccess = epoll_ctl(hEpoll, EPOLL_CTL_ADD, hWakeupPipe[0], &event) == 0;
+    for (size_t i = 0; fSuccess && i < vhListenSocket.size(); i++) {
+        event.data.u64 = EPOLL_TOKEN_LISTEN + i;
+        fSuccess = epoll_ctl(hEpoll, EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) == 0;
+    }
+    if (!fSuccess) {
+        int nErr = errno;
+        CloseSocketEvents();
+        return error("%s: epoll_ctl failed: %s", __func__, NetworkErrorString(nErr));
+    }
+    return true;
+}
+#endif
+
+static void DisconnectNodes(unsigned int& nPrevNodeCount)
+{
+    {
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*> vNodesCopy = vNodes;
+        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+            if (pnode->fDisconnect ||
+                (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty())) {
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
+
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
+
+                // hold in disconnected pool until all refs are released
+                if (pnode->fNetworkNode || pnode->fInbound)
+                    pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
-        {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH (CNode* pnode, vNodesDisconnectedCopy) {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0) {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend) {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv) {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        BOOST_FOREACH (CNode* pnode, vNodesDisconnectedCopy) {
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0) {
+                bool fDelete = false;
+                {
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend) {
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv) {
+                            TRY_LOCK(pnode->cs_inventory, lockInv);
+                            if (lockInv)
+                                fDelete = true;
                         }
                     }
-                    if (fDelete) {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
-                    }
+                }
+                if (fDelete) {
+                    vNodesDisconnected.remove(pnode);
+                    delete pnode;
                 }
             }
         }
-        size_t vNodesSize;
+    }
+    size_t vNodesSize;
+    {
+        LOCK(cs_vNodes);
+        vNodesSize = vNodes.size();
+    }
+    if(vNodesSize != nPrevNodeCount) {
+        nPrevNodeCount = vNodesSize;
+        uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+static void AcceptConnection(const ListenSocket& hListenSocket)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
+
+    if (hSocket != INVALID_SOCKET)
+        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+            LogPrintf("Warning: Unknown socket family\n");
+
+    bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (hSocket == INVALID_SOCKET) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+    } else if (!fSocketEventsEpoll && !IsSelectableSocket(hSocket)) {
+        LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
+        LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (CNode::IsBanned(addr) && !whitelisted) {
+        LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else {
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        pnode->fWhitelisted = whitelisted;
+
         {
             LOCK(cs_vNodes);
-            vNodesSize = vNodes.size();
+            vNodes.push_back(pnode);
         }
-        if(vNodesSize != nPrevNodeCount) {
-            nPrevNodeCount = vNodesSize;
-            uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+// requires LOCK(cs_vRecvMsg)
+static bool ReceiveBufferHasSpace(CNode* pnode)
+{
+    return pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+           pnode->GetTotalRecvSize() <= ReceiveFloodSize();
+}
+
+// requires LOCK(cs_vRecvMsg), returns false once the socket has nothing more to read
+static bool SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0) {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        return pnode->hSocket != INVALID_SOCKET;
+    } else if (nBytes == 0) {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    } else if (nBytes < 0) {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
         }
+        return nErr == WSAEINTR;
+    }
+    return false;
+}
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+static void InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60) {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+static void SocketEventsSelect()
+{
+    //
+    // Find which sockets have data to receive
+    //
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SOCKET_EVENTS_POLL_TIMEOUT * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
 
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
             have_fds = true;
-        }
 
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && ReceiveBufferHasSpace(pnode))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
         }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+        &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec / 1000);
+    }
+
+    //
+    // Accept new connections
+    //
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            AcceptConnection(hListenSocket);
+    }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    //
+    // Service each socket
+    //
+    vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->AddRef();
+    }
+    BOOST_FOREACH (CNode* pnode, vNodesCopy) {
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
+        //
+        // Receive
+        //
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (lockRecv)
+                SocketRecvData(pnode);
         }
 
         //
-        // Accept new connections
+        // Send
         //
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                struct sockaddr_storage sockaddr;
-                socklen_t len = sizeof(sockaddr);
-                SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
-                CAddress addr;
-                int nInbound = 0;
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend)
+                SocketSendData(pnode);
+        }
+
+        //
+        // Inactivity checking
+        //
+        InactivityCheck(pnode);
+    }
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->Release();
+    }
+}
 
-                if (hSocket != INVALID_SOCKET)
-                    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                        LogPrintf("Warning: Unknown socket family\n");
+#ifdef HAVE_EPOLL
+/** Whether pnode has data queued; as in the select() loop, a node whose send lock is busy counts as having none */
+static bool HasSendData(CNode* pnode)
+{
+    TRY_LOCK(pnode->cs_vSend, lockSend);
+    return lockSend && !pnode->vSendMsg.empty();
+}
 
-                bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
-                {
-                    LOCK(cs_vNodes);
-                    BOOST_FOREACH (CNode* pnode, vNodes)
-                        if (pnode->fInbound)
-                            nInbound++;
-                }
+/**
+ * Node sockets are registered once, edge-triggered, and their readiness is
+ * kept in fHasRecvData and fCanSendData until a recv or send would block. The
+ * thread sleeps until a socket becomes ready or WakeupSocketHandler is called,
+ * and only polls while a node has data it could not move yet.
+ */
+static void SocketEventsEpoll()
+{
+    vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->AddRef();
+    }
 
-                if (hSocket == INVALID_SOCKET) {
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK)
-                        LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
-                    LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
-                    LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (CNode::IsBanned(addr) && !whitelisted) {
-                    LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else {
-                    CNode* pnode = new CNode(hSocket, addr, "", true);
-                    pnode->AddRef();
-                    pnode->fWhitelisted = whitelisted;
-
-                    {
-                        LOCK(cs_vNodes);
-                        vNodes.push_back(pnode);
-                    }
-                }
+    std::map<NodeId, CNode*> mapNodes;
+    int nTimeout = SOCKET_EVENTS_IDLE_TIMEOUT;
+    BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (!pnode->fSocketRegistered) {
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.u64 = pnode->id;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+                pnode->CloseSocketDisconnect();
+                continue;
             }
+            pnode->fSocketRegistered = true;
         }
+        mapNodes[pnode->id] = pnode;
 
-        //
-        // Service each socket
-        //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->AddRef();
+        // Same priorities as the select() loop: drain the send queue before receiving more
+        bool fHasSendData = HasSendData(pnode);
+        if ((pnode->fCanSendData && fHasSendData) || (pnode->fHasRecvData && !fHasSendData))
+            nTimeout = SOCKET_EVENTS_POLL_TIMEOUT;
+    }
+
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int nEvents = epoll_wait(hEpoll, events, EPOLL_MAX_EVENTS, nTimeout);
+    boost::this_thread::interruption_point();
+
+    if (nEvents < 0) {
+        int nErr = errno;
+        if (nErr != EINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            MilliSleep(SOCKET_EVENTS_POLL_TIMEOUT);
         }
-        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-            boost::this_thread::interruption_point();
+        nEvents = 0;
+    }
 
-            //
-            // Receive
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+    for (int i = 0; i < nEvents; i++) {
+        uint64_t nToken = events[i].data.u64;
+        if (nToken == EPOLL_TOKEN_WAKEUP) {
+            char buf[128];
+            while (read(hWakeupPipe[0], buf, sizeof(buf)) > 0) {
             }
-
-            //
-            // Send
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
+        } else if (nToken >= EPOLL_TOKEN_LISTEN) {
+            if (nToken - EPOLL_TOKEN_LISTEN < vhListenSocket.size())
+                AcceptConnection(vhListenSocket[nToken - EPOLL_TOKEN_LISTEN]);
+        } else {
+            std::map<NodeId, CNode*>::iterator it = mapNodes.find((NodeId)nToken);
+            if (it == mapNodes.end())
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
-                TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    SocketSendData(pnode);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                it->second->fHasRecvData = true;
+            if (events[i].events & EPOLLOUT)
+                it->second->fCanSendData = true;
+        }
+    }
+
+    //
+    // Service each socket
+    //
+    BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+        boost::this_thread::interruption_point();
+
+        //
+        // Send
+        //
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (pnode->fCanSendData) {
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend && !pnode->vSendMsg.empty()) {
+                SocketSendData(pnode);
+                // what is left did not fit into the socket buffer, wait for EPOLLOUT
+                if (!pnode->vSendMsg.empty())
+                    pnode->fCanSendData = false;
             }
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
+        //
+        // Receive until the socket would block or the receive buffer is full
+        //
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (pnode->fHasRecvData && !HasSendData(pnode)) {
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (lockRecv) {
+                while (pnode->fHasRecvData && ReceiveBufferHasSpace(pnode))
+                    pnode->fHasRecvData = SocketRecvData(pnode);
             }
         }
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->Release();
+
+        //
+        // Inactivity checking
+        //
+        InactivityCheck(pnode);
+    }
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->Release();
+    }
+}
+#endif
+
+void ThreadSocketHandler()
+{
+    unsigned int nPrevNodeCount = 0;
+    while (true) {
+        //
+        // Disconnect nodes
+        //
+        DisconnectNodes(nPrevNodeCount);
+
+#ifdef HAVE_EPOLL
+        if (fSocketEventsEpoll) {
+            SocketEventsEpoll();
+            continue;
         }
+#endif
+        SocketEventsSelect();
     }
 }
 
@@ -1510,12 +1950,110 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 }
 
 
-void ThreadMessageHandler()
+/**
+ * One round of message handling for pnode: process its next messages and
+ * let it send. Returns whether it has more work ready right away.
+ */
+static bool ProcessNodeMessages(CNode* pnode, bool fSendTrickle)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    bool fMore = false;
+
+    // Receive messages
+    {
+        // DLOCKSFIX: send is most often needed within receive, resulting in
+        // deadlock warnings (cs_vSend at the end of chain, while we also have cs_vSend, cs_main)
+
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv) {
+            if (!g_signals.ProcessMessages(pnode))
+                pnode->CloseSocketDisconnect();
+
+            if (pnode->nSendSize < SendBufferSize()) {
+                if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
+                    fMore = true;
+                }
+            }
+        }
+    }
+    boost::this_thread::interruption_point();
+
+    // Send messages
+    {
+        // DLOCKSFIX: order of locks: 
+        // cs_vRecvMsg, cs_main (main: ProcessMessage...), cs_vSend (PushMessage)
+        // cs_vSend, cs_main (main: SendMessages) 
+        // SendMessages acquires cs_main right after the call, just in wrong order
+        // (cs_main should go first, cs_vSend is always called from inside
+        TRY_LOCK(cs_main, lockMain);
+        if (lockMain) {
+            // DLOCKSFIX: order of locks: cs_main, mempool.cs, ...
+            // I'm reluctantly doing this but almost always mempool goes along
+            TRY_LOCK(mempool.cs, lockMempool);
+            if (lockMempool) {
+                if (pnode->nVersion != 0)
+                {
+                    // DLOCKSFIX: AddressRefreshBroadcast <= a signal of its own. The idea is to separate the locks, as it's isolated code. Just something we have to do from time to time, SendMessages was used as a trigger
+                    TRY_LOCK(cs_vNodes, lockNodes);
+                    if (lockNodes) {
+                        g_signals.AddressRefreshBroadcast();
+                    }
+                }
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend) {
+                    g_signals.SendMessages(pnode, fSendTrickle);
+                }
+            }
+        }
+    }
+    boost::this_thread::interruption_point();
+
+    return fMore && !pnode->fDisconnect;
+}
 
+/**
+ * Processes the peers handed over by QueueMessageWork. A peer is in the queue
+ * at most once and handled by one thread at a time, so its messages keep
+ * their order, while different peers are served in parallel.
+ */
+static void ThreadMessageWorker()
+{
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    while (true) {
+        std::pair<CNode*, bool> work;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexMessageWork);
+            while (queueMessageWork.empty())
+                condMessageWork.wait(lock);
+            work = queueMessageWork.front();
+            queueMessageWork.pop_front();
+            vMessageWorkDepth[MessageStatsBucket(queueMessageWork.size(), true)]++;
+        }
+
+        CNode* pnode = work.first;
+        bool fMore = !pnode->fDisconnect && ProcessNodeMessages(pnode, work.second);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutexMessageWork);
+            if (fMore) {
+                // back of the queue, so busy peers take turns with the others
+                queueMessageWork.push_back(std::make_pair(pnode, false));
+                condMessageWork.notify_one();
+                continue;
+            }
+            pnode->fMessageWorkQueued = false;
+        }
+        LOCK(cs_vNodes);
+        pnode->Release();
+    }
+}
+
+/**
+ * Queues every peer for the message handler threads each
+ * MESSAGE_HANDLER_INTERVAL, so that SendMessages runs for idle peers too.
+ * Peers with new messages are queued by the socket handler as they arrive.
+ */
+void ThreadMessageHandler()
+{
     while (true) {
         vector<CNode*> vNodesCopy;
         {
@@ -1526,76 +2064,31 @@ void ThreadMessageHandler()
             }
         }
 
-        // Poll the connected nodes for messages
         CNode* pnodeTrickle = NULL;
         if (!vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
-        bool fSleep = true;
-
-        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-            if (pnode->fDisconnect)
-                continue;
-
-            // Receive messages
-            {
-                // DLOCKSFIX: send is most often needed within receive, resulting in
-                // deadlock warnings (cs_vSend at the end of chain, while we also have cs_vSend, cs_main)
-
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    if (!g_signals.ProcessMessages(pnode))
-                        pnode->CloseSocketDisconnect();
-
-                    if (pnode->nSendSize < SendBufferSize()) {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
-                            fSleep = false;
-                        }
-                    }
-                }
-            }
-            boost::this_thread::interruption_point();
-
-            // Send messages
-            {
-                // DLOCKSFIX: order of locks: 
-                // cs_vRecvMsg, cs_main (main: ProcessMessage...), cs_vSend (PushMessage)
-                // cs_vSend, cs_main (main: SendMessages) 
-                // SendMessages acquires cs_main right after the call, just in wrong order
-                // (cs_main should go first, cs_vSend is always called from inside
-                TRY_LOCK(cs_main, lockMain);
-                if (lockMain) {
-                    // DLOCKSFIX: order of locks: cs_main, mempool.cs, ...
-                    // I'm reluctantly doing this but almost always mempool goes along
-                    TRY_LOCK(mempool.cs, lockMempool);
-                    if (lockMempool) {
-                        if (pnode->nVersion != 0)
-                        {
-                            // DLOCKSFIX: AddressRefreshBroadcast <= a signal of its own. The idea is to separate the locks, as it's isolated code. Just something we have to do from time to time, SendMessages was used as a trigger
-                            TRY_LOCK(cs_vNodes, lockNodes);
-                            if (lockNodes) {
-                                g_signals.AddressRefreshBroadcast();
-                            }
-                        }
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend) {
-                            g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
-                        }
-                    }
+        vector<CNode*> vNodesRelease;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexMessageWork);
+            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+                if (pnode->fDisconnect || pnode->fMessageWorkQueued) {
+                    vNodesRelease.push_back(pnode);
+                    continue;
                 }
+                pnode->fMessageWorkQueued = true;
+                queueMessageWork.push_back(std::make_pair(pnode, pnode == pnodeTrickle || pnode->fWhitelisted));
             }
-            boost::this_thread::interruption_point();
         }
-
+        condMessageWork.notify_all();
 
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            BOOST_FOREACH (CNode* pnode, vNodesRelease)
                 pnode->Release();
         }
 
-        if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        MilliSleep(MESSAGE_HANDLER_INTERVAL);
     }
 }
 
@@ -1869,6 +2362,14 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Map ports with UPnP
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
+#ifdef HAVE_EPOLL
+    if (fSocketEventsEpoll && !StartSocketEvents()) {
+        LogPrintf("Falling back to -socketevents=select\n");
+        fSocketEventsEpoll = false;
+    }
+#endif
+    LogPrintf("Using %s for socket events\n", fSocketEventsEpoll ? "epoll" : "select");
+
     // Send and receive from sockets, accept connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
@@ -1879,6 +2380,10 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
+    nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MESSAGE_HANDLER_THREADS), MAX_MESSAGE_HANDLER_THREADS));
+    LogPrintf("Using %d message handler threads\n", nMessageHandlerThreads);
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgwork", &ThreadMessageWorker));
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
 
     // Dump network addresses
@@ -1940,6 +2445,9 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+#ifdef HAVE_EPOLL
+        CloseSocketEvents();
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
@@ -1979,8 +2487,9 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        // Save original serialized message so newer versions are preserved,
+        // framed once for every peer that asks for it
+        mapRelay.insert(std::make_pair(inv, MakeSharedMessage(inv.GetCommand(), ss)));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -2208,6 +2717,10 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fSocketRegistered = false;
+    fHasRecvData = false;
+    fCanSendData = false;
+    fMessageWorkQueued = false;
     hashContinue = 0;
     nStartingHeight = -1;
     fGetAddr = false;
@@ -2310,28 +2823,51 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     if (ssSend.size() == 0)
         return;
 
-    // Set the size
+    FinalizeMessageHeader(ssSend);
+
     unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+    LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size() >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    boost::shared_ptr<CSerializeData> pdata(new CSerializeData());
+    ssSend.GetAndClear(*pdata);
+    QueueSendMessage(pdata);
 
-    LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+void CNode::PushSharedMessage(const CSerializeDataRef& pmessage)
+{
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: shared (%d bytes) peer=%d\n", pmessage->size() - CMessageHeader::HEADER_SIZE, id);
+    QueueSendMessage(pmessage);
+}
+
+void CNode::QueueSendMessage(const CSerializeDataRef& pmessage)
+{
+    vSendMsg.push_back(pmessage);
+    nSendSize += pmessage->size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
-    LEAVE_CRITICAL_SECTION(cs_vSend);
+    // Let the socket handler send the rest
+    if (!vSendMsg.empty())
+        WakeupSocketHandler();
+}
+
+void FinalizeMessageHeader(CDataStream& ssMessage)
+{
+    // Set the size
+    unsigned int nSize = ssMessage.size() - CMessageHeader::HEADER_SIZE;
+    memcpy((char*)&ssMessage[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+
+    // Set the checksum
+    uint256 hash = Hash(ssMessage.begin() + CMessageHeader::HEADER_SIZE, ssMessage.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ssMessage.size() >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ssMessage[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
 }
 
 //
@@ -19,6 +19,7 @@
 #include "sync.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
+#include "version.h"
 
 #include <deque>
 #include <stdint.h>
@@ -29,6 +30,7 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 
 class CAddrMan;
@@ -61,6 +63,24 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Most queued messages handed to one sendmsg by SocketSendData */
+static const int MAX_SEND_IOV = 64;
+/** -socketevents default, how ThreadSocketHandler waits for socket readiness */
+#ifdef HAVE_EPOLL
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** -msghandlerthreads default, threads that process the messages of the peers */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
+/** Interval at which every peer gets a turn in a message handler thread (milliseconds) */
+static const int MESSAGE_HANDLER_INTERVAL = 100;
+/** Number of buckets of the message processing histograms */
+static const unsigned int MESSAGE_STATS_BUCKETS = 7;
+/** Message types with their own statistics, later types are counted as "other" */
+static const unsigned int MAX_MESSAGE_STATS_TYPES = 64;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -81,6 +101,81 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode* pnode);
 
+/**
+ * A complete serialized message, header included, that is never modified
+ * once built. The send queues of any number of peers may hold it.
+ */
+typedef boost::shared_ptr<const CSerializeData> CSerializeDataRef;
+
+/** Fill in the size and checksum of the message header at the start of ssMessage */
+void FinalizeMessageHeader(CDataStream& ssMessage);
+
+/** Serialize a message once so that it can be pushed to many peers with CNode::PushSharedMessage */
+template <typename T>
+CSerializeDataRef MakeSharedMessage(const char* pszCommand, const T& payload)
+{
+    CDataStream ssMessage(SER_NETWORK, PROTOCOL_VERSION);
+    ssMessage << CMessageHeader(pszCommand, 0) << payload;
+    FinalizeMessageHeader(ssMessage);
+    boost::shared_ptr<CSerializeData> pdata(new CSerializeData());
+    ssMessage.GetAndClear(*pdata);
+    return pdata;
+}
+
+/**
+ * Receive buffers are kept for reuse in size classes of powers of two from
+ * RECV_BUFFER_MIN_SIZE up to MAX_PROTOCOL_MESSAGE_LENGTH, so that peers
+ * sending blocks at the same time do not each allocate and free megabytes
+ * per message.
+ */
+static const unsigned int RECV_BUFFER_MIN_SIZE = 1024;
+static const unsigned int RECV_BUFFER_CLASSES = 12;
+//! Most bytes of idle buffers kept per size class, at least one buffer is always kept
+static const size_t RECV_BUFFER_POOL_CLASS_BYTES = 4 * 1024 * 1024;
+
+//! Replace vchOut with an empty buffer with room for at least nSize bytes
+void AcquireRecvBuffer(size_t nSize, CSerializeData& vchOut);
+//! Keep the allocation of vch for later messages, vch is left empty
+void ReleaseRecvBuffer(CSerializeData& vch);
+//! Number of idle buffers kept for messages of nSize bytes
+size_t GetRecvBufferPoolCount(size_t nSize);
+
+/** Select the -socketevents mode, returns false if it is unknown or not available in this build */
+bool SetSocketEvents(const std::string& strMode);
+/** Whether sockets are waited for with epoll, which has no FD_SETSIZE limit */
+bool IsSocketEventsEpoll();
+/** Make ThreadSocketHandler look at the nodes again, e.g. after queueing data or adding a node */
+void WakeupSocketHandler();
+#ifdef HAVE_EPOLL
+/** Create the epoll instance and register the wakeup pipe and the listening sockets with it, done by StartNode */
+bool StartSocketEvents();
+/** Close the epoll instance and the wakeup pipe, done by StopNode */
+void CloseSocketEvents();
+#endif
+
+/**
+ * Processing statistics of one message type. Times are in microseconds, the
+ * histograms count decades from 100us (wait, time) and powers of two
+ * (depth); the last bucket takes everything above.
+ */
+struct CMessageStats {
+    uint64_t nCount;
+    int64_t nTotalWait;  //!< from receipt until processing started
+    int64_t nTotalTime;  //!< spent processing
+    uint64_t vWait[MESSAGE_STATS_BUCKETS];
+    uint64_t vTime[MESSAGE_STATS_BUCKETS];
+    uint64_t vDepth[MESSAGE_STATS_BUCKETS]; //!< messages of the peer still queued behind it
+
+    CMessageStats();
+};
+
+/** Histogram bucket of a duration in microseconds, or of a queue depth with fDepth */
+unsigned int MessageStatsBucket(int64_t nValue, bool fDepth);
+void RecordMessageStats(const std::string& strCommand, int64_t nWait, int64_t nTime, size_t nDepth);
+/** Statistics per message type, and the histogram of peers waiting for a message handler thread */
+void GetMessageStats(std::map<std::string, CMessageStats>& mapStatsOut, std::vector<uint64_t>& vWorkQueueOut);
+int GetMessageHandlerThreads();
+
 typedef int NodeId;
 
 // Signals for message handling
@@ -134,7 +229,8 @@ extern int MAX_OUTBOUND_CONNECTIONS;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+//! Recently relayed messages by inventory, ready to be pushed in reply to getdata
+extern std::map<CInv, CSerializeDataRef> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -185,7 +281,7 @@ public:
     CMessageHeader hdr; // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv; // received message data
+    CDataStream vRecv; // received message data, in a buffer from the receive buffer pool
     unsigned int nDataPos;
 
     int64_t nTime; // time (in microseconds) of message receipt.
@@ -199,6 +295,9 @@ public:
         nTime = 0;
     }
 
+    //! Hands the data buffer back to the receive buffer pool
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -290,8 +389,14 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializeDataRef> vSendMsg;
     CCriticalSection cs_vSend;
+    // readiness of hSocket in epoll mode, only used by ThreadSocketHandler
+    bool fSocketRegistered;
+    bool fHasRecvData;
+    bool fCanSendData;
+    // queued for or being processed by a message handler thread, guarded by the work queue
+    bool fMessageWorkQueued;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -495,6 +600,12 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    //! Queue a message built with MakeSharedMessage, without copying it
+    void PushSharedMessage(const CSerializeDataRef& pmessage);
+
+    //! Append a finished message to vSendMsg and start sending it, cs_vSend must be held
+    void QueueSendMessage(const CSerializeDataRef& pmessage) EXCLUSIVE_LOCKS_REQUIRED(cs_vSend);
+
     void PushVersion();
 
 
@@ -13,6 +13,12 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+/** Below this many headers per thread the thread start up costs more than it saves */
+static const size_t MIN_HEADERS_PER_HASH_THREAD = 256;
+
 uint256 CBlockHeader::GetHash() const
 {
     if (nVersion < VERSION5)
@@ -21,6 +27,32 @@ uint256 CBlockHeader::GetHash() const
         return Hash(BEGIN(nVersion), END(nAccumulatorCheckpoint));
 }
 
+static void HashHeaderRange(const std::vector<CBlockHeader>* pvHeaders, std::vector<uint256>* pvHashes, size_t nStart, size_t nStride)
+{
+    for (size_t i = nStart; i < pvHeaders->size(); i += nStride)
+        (*pvHashes)[i] = (*pvHeaders)[i].GetHash();
+}
+
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes)
+{
+    vHashes.resize(vHeaders.size());
+
+    size_t nThreads = std::min((size_t)std::max(boost::thread::hardware_concurrency(), 1U),
+                               vHeaders.size() / MIN_HEADERS_PER_HASH_THREAD);
+    if (nThreads <= 1) {
+        HashHeaderRange(&vHeaders, &vHashes, 0, 1);
+        return;
+    }
+
+    // Interleave the headers over the threads so runs of cheap post-zerocoin
+    // headers are shared evenly; the calling thread takes the first lane.
+    boost::thread_group threadGroup;
+    for (size_t n = 1; n < nThreads; n++)
+        threadGroup.create_thread(boost::bind(&HashHeaderRange, &vHeaders, &vHashes, n, nThreads));
+    HashHeaderRange(&vHeaders, &vHashes, 0, nThreads);
+    threadGroup.join_all();
+}
+
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
 {
     /* WARNING! If you're reading this because you're learning about crypto
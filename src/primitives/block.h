@@ -92,6 +92,12 @@ public:
     }
 };
 
+/**
+ * Compute the hashes of a batch of headers. Pre-zerocoin headers use the
+ * nine round Quark chain, so large batches are split over all cores.
+ */
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes);
+
 
 class CBlock : public CBlockHeader
 {
@@ -8,8 +8,11 @@
 #include <limits.h>
 #include "libzerocoin/bignum.h"
 #include "libzerocoin/Denominations.h"
+#include "primitives/transaction.h"
 #include "serialize.h"
 
+#include <vector>
+
 class CZerocoinMint
 {
 private:
@@ -172,6 +175,49 @@ public:
     };
 };
 
+/** A mint output, as kept in the per-block mint index */
+class CZerocoinBlockMint
+{
+public:
+    unsigned int nOut;
+    libzerocoin::CoinDenomination denomination;
+    CBigNum value;
+
+    CZerocoinBlockMint() : nOut(0), denomination(libzerocoin::ZQ_ERROR) {}
+    CZerocoinBlockMint(unsigned int nOutIn, libzerocoin::CoinDenomination denomIn, const CBigNum& valueIn) : nOut(nOutIn), denomination(denomIn), value(valueIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nOut);
+        READWRITE(denomination);
+        READWRITE(value);
+    };
+};
+
+/**
+ * The mints of one transaction in the per-block mint index. The inputs are
+ * kept so that mints spending invalid outpoints can be filtered on reading,
+ * the same way BlockToPubcoinList filters them.
+ */
+class CZerocoinBlockMintTx
+{
+public:
+    uint256 txid;
+    std::vector<COutPoint> vPrevouts;
+    std::vector<CZerocoinBlockMint> vMints; //!< in output order
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(vPrevouts);
+        READWRITE(vMints);
+    };
+};
+
 class CZerocoinSpendReceipt
 {
 private:
@@ -31,7 +31,8 @@ static const char* ppszTypeName[] =
         "mn quorum",
         "mn announce",
         "mn ping",
-        "dstx"};
+        "dstx",
+        "compact block"};
 
 CMessageHeader::CMessageHeader()
 {
@@ -137,7 +138,7 @@ bool CInv::IsKnownType() const
 }
 
 bool CInv::IsMasterNodeType() const{
- 	return (type >= 6);
+ 	return (type >= 6 && type <= MSG_DSTX);
 }
 
 const char* CInv::GetCommand() const
@@ -10,10 +10,12 @@
 #include "clientversion.h"
 #include "main.h"
 #include "rpcserver.h"
+#include "script/sigcache.h"
 #include "sync.h"
 #include "txdb.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "zerocoinspendcache.h"
 
 #include <stdint.h>
 #include <univalue.h>
@@ -1003,3 +1005,102 @@ UniValue findserial(const UniValue& params, bool fHelp)
 
     return ret;
 }
+
+UniValue getspendcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getspendcacheinfo\n"
+                "\nReturns statistics of the cache of already verified zerocoin spends.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"size\": xxxxx                (numeric) Number of verified spends in the cache\n"
+                "  \"maxsize\": xxxxx             (numeric) Maximum number of cached spends (-maxspendcachesize)\n"
+                "  \"hits\": xxxxx                (numeric) Lookups that skipped proof verification\n"
+                "  \"misses\": xxxxx              (numeric) Lookups that required proof verification\n"
+                "}\n"
+                "\nExamples:\n" +
+            HelpExampleCli("getspendcacheinfo", "") + HelpExampleRpc("getspendcacheinfo", ""));
+
+    uint64_t nHits, nMisses, nSize;
+    zerocoinSpendCache.GetStats(nHits, nMisses, nSize);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("size", nSize));
+    ret.push_back(Pair("maxsize", GetArg("-maxspendcachesize", DEFAULT_MAX_SPEND_CACHE_SIZE)));
+    ret.push_back(Pair("hits", nHits));
+    ret.push_back(Pair("misses", nMisses));
+
+    return ret;
+}
+
+UniValue getsigcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+                "\nReturns statistics of the cache of already verified script signatures.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"bytes\": xxxxx               (numeric) Memory reserved for the cache (-sigcachesize)\n"
+                "  \"elements\": xxxxx            (numeric) Number of signatures the cache can hold\n"
+                "  \"hits\": xxxxx                (numeric) Lookups that skipped signature verification\n"
+                "  \"misses\": xxxxx              (numeric) Lookups that required signature verification\n"
+                "  \"hitrate\": x.xxx             (numeric) Fraction of lookups that were hits\n"
+                "}\n"
+                "\nExamples:\n" +
+            HelpExampleCli("getsigcacheinfo", "") + HelpExampleRpc("getsigcacheinfo", ""));
+
+    uint64_t nHits, nMisses;
+    size_t nBytes;
+    uint32_t nElements;
+    GetSignatureCacheStats(nHits, nMisses, nBytes, nElements);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("bytes", (uint64_t)nBytes));
+    ret.push_back(Pair("elements", (uint64_t)nElements));
+    ret.push_back(Pair("hits", nHits));
+    ret.push_back(Pair("misses", nMisses));
+    ret.push_back(Pair("hitrate", nHits + nMisses ? (double)nHits / (nHits + nMisses) : 0.0));
+
+    return ret;
+}
+
+UniValue getcoinsflushinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcoinsflushinfo\n"
+                "\nReturns statistics of the writes of the coins cache to the coin database.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"queue\": xxxxx              (numeric) Flushes that may be pending in the background (-coinsflushqueue)\n"
+                "  \"pending\": xxxxx            (numeric) Flushes currently waiting to be written\n"
+                "  \"pendingusage\": xxxxx       (numeric) Memory held by the pending flushes, counted against -dbcache\n"
+                "  \"flushes\": xxxxx            (numeric) Flushes written since startup\n"
+                "  \"stalls\": xxxxx             (numeric) Flushes that waited for the queue to drain\n"
+                "  \"lastduration\": xxxxx       (numeric) Duration of the last write in milliseconds\n"
+                "  \"totalduration\": xxxxx      (numeric) Duration of all writes in milliseconds\n"
+                "  \"lastbytes\": xxxxx          (numeric) Bytes written by the last flush\n"
+                "  \"totalbytes\": xxxxx         (numeric) Bytes written by all flushes\n"
+                "}\n"
+                "\nExamples:\n" +
+            HelpExampleCli("getcoinsflushinfo", "") + HelpExampleRpc("getcoinsflushinfo", ""));
+
+    CCoinsFlushStats stats;
+    if (pcoinsFlush)
+        pcoinsFlush->GetFlushStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("queue", GetArg("-coinsflushqueue", DEFAULT_COINS_FLUSH_QUEUE)));
+    ret.push_back(Pair("pending", (uint64_t)stats.nPending));
+    ret.push_back(Pair("pendingusage", (uint64_t)stats.nPendingUsage));
+    ret.push_back(Pair("flushes", stats.nFlushes));
+    ret.push_back(Pair("stalls", stats.nStalls));
+    ret.push_back(Pair("lastduration", stats.nLastDuration / 1000.0));
+    ret.push_back(Pair("totalduration", stats.nTotalDuration / 1000.0));
+    ret.push_back(Pair("lastbytes", stats.nLastBytes));
+    ret.push_back(Pair("totalbytes", stats.nTotalBytes));
+
+    return ret;
+}
@@ -20,6 +20,7 @@
 #include "autoupdatemodel.h"
 
 #ifdef ENABLE_WALLET
+#include "kernel.h"
 #include "wallet.h"
 #include "walletdb.h"
 #endif
@@ -562,6 +563,9 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"stakecandidates\": n,             (numeric) coins whose kernels were searched in the last stake search\n"
+            "  \"kernelhashes\": n,                (numeric) kernel hashes computed in the last stake search\n"
+            "  \"hashespersec\": n,                (numeric) kernel hash rate of the last stake search\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -590,6 +594,12 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    CStakeSearchStats stats;
+    GetStakeSearchStats(stats);
+    obj.push_back(Pair("stakecandidates", (uint64_t)stats.nCandidates));
+    obj.push_back(Pair("kernelhashes", stats.nHashes));
+    obj.push_back(Pair("hashespersec", stats.nDuration > 0 ? (uint64_t)(stats.nHashes * 1000000 / stats.nDuration) : 0));
+
     return obj;
 }
 #endif // ENABLE_WALLET
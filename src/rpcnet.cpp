@@ -353,6 +353,106 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+static UniValue MessageStatsHistogram(const uint64_t* pnCounts)
+{
+    UniValue histogram(UniValue::VARR);
+    for (unsigned int i = 0; i < MESSAGE_STATS_BUCKETS; i++)
+        histogram.push_back(pnCounts[i]);
+    return histogram;
+}
+
+UniValue getmessagestats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getmessagestats\n"
+            "\nReturns statistics of the processing of peer messages since startup.\n"
+            "Time histograms count durations below 0.1, 1, 10, 100, 1000 and 10000 ms and above,\n"
+            "depth histograms count queue lengths of 0, 1, below 4, 8, 16, 32 and above.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,               (numeric) Message handler threads (-msghandlerthreads)\n"
+            "  \"workqueue\": [ n,... ],     (array) Depth histogram of the peers waiting for a thread\n"
+            "  \"messages\": {\n"
+            "    \"command\": {              (string) The message type\n"
+            "      \"count\": n,             (numeric) Messages processed\n"
+            "      \"avgwait\": n,           (numeric) Average time from receipt to processing in milliseconds\n"
+            "      \"avgtime\": n,           (numeric) Average processing time in milliseconds\n"
+            "      \"wait\": [ n,... ],      (array) Time histogram from receipt to processing\n"
+            "      \"time\": [ n,... ],      (array) Time histogram of the processing\n"
+            "      \"depth\": [ n,... ]      (array) Depth histogram of the messages queued behind by the peer\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagestats", "") + HelpExampleRpc("getmessagestats", ""));
+
+    std::map<std::string, CMessageStats> mapStats;
+    std::vector<uint64_t> vWorkQueue;
+    GetMessageStats(mapStats, vWorkQueue);
+
+    UniValue messages(UniValue::VOBJ);
+    for (std::map<std::string, CMessageStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CMessageStats& stats = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("avgwait", stats.nCount ? stats.nTotalWait / 1000.0 / stats.nCount : 0.0));
+        obj.push_back(Pair("avgtime", stats.nCount ? stats.nTotalTime / 1000.0 / stats.nCount : 0.0));
+        obj.push_back(Pair("wait", MessageStatsHistogram(stats.vWait)));
+        obj.push_back(Pair("time", MessageStatsHistogram(stats.vTime)));
+        obj.push_back(Pair("depth", MessageStatsHistogram(stats.vDepth)));
+        messages.push_back(Pair(SanitizeString(it->first), obj));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("threads", GetMessageHandlerThreads()));
+    ret.push_back(Pair("workqueue", MessageStatsHistogram(&vWorkQueue[0])));
+    ret.push_back(Pair("messages", messages));
+    return ret;
+}
+
+UniValue getcompactblockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getcompactblockstats\n"
+            "\nReturns statistics of compact block relay since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,     (boolean) Whether compact blocks are requested and served (-compactblocks)\n"
+            "  \"received\": n,             (numeric) Requested compact blocks received\n"
+            "  \"reconstructed\": n,        (numeric) Blocks rebuilt from the compact block and the mempool alone\n"
+            "  \"roundtrips\": n,           (numeric) Blocks that needed a getblocktxn request\n"
+            "  \"failed\": n,               (numeric) Blocks downloaded in full after all\n"
+            "  \"prefilledtxs\": n,         (numeric) Transactions received within compact blocks\n"
+            "  \"mempooltxs\": n,           (numeric) Transactions found in the mempool\n"
+            "  \"requestedtxs\": n,         (numeric) Transactions requested with getblocktxn\n"
+            "  \"hitrate\": n,              (numeric) Share of the short ids found in the mempool\n"
+            "  \"sent\": n,                 (numeric) Compact blocks sent\n"
+            "  \"senttxs\": n               (numeric) Transactions sent in reply to getblocktxn\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getcompactblockstats", "") + HelpExampleRpc("getcompactblockstats", ""));
+
+    CCompactBlockStats stats;
+    GetCompactBlockStats(stats);
+
+    uint64_t nShortIDs = stats.nTxFromMempool + stats.nTxRequested;
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS)));
+    ret.push_back(Pair("received", stats.nReceived));
+    ret.push_back(Pair("reconstructed", stats.nReconstructed));
+    ret.push_back(Pair("roundtrips", stats.nRoundTrips));
+    ret.push_back(Pair("failed", stats.nFailed));
+    ret.push_back(Pair("prefilledtxs", stats.nTxPrefilled));
+    ret.push_back(Pair("mempooltxs", stats.nTxFromMempool));
+    ret.push_back(Pair("requestedtxs", stats.nTxRequested));
+    ret.push_back(Pair("hitrate", nShortIDs ? (double)stats.nTxFromMempool / nShortIDs : 1.0));
+    ret.push_back(Pair("sent", stats.nSent));
+    ret.push_back(Pair("senttxs", stats.nTxSent));
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -5,13 +5,16 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <atomic>
+
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
 
 namespace {
 
@@ -23,68 +26,108 @@ namespace {
 class CSignatureCache
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
+    //! Entries are SHA256(nonce || signature hash || public key || signature):
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
     boost::shared_mutex cs_sigcache;
 
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
 public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    CSignatureCache() : nHits(0), nMisses(0)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        GetRandBytes(nonce.begin(), 32);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    void
+    ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.empty() ? NULL : &vchSig[0], vchSig.size()).Finalize(entry.begin());
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    bool
+    Get(const uint256& entry, const bool erase)
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        bool fFound;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+            fFound = setValid.contains(entry, erase);
+        }
+        if (fFound)
+            nHits++;
+        else
+            nMisses++;
+        return fFound;
+    }
 
+    void Set(const uint256& entry)
+    {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        setValid.insert(entry);
+    }
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    void GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut)
+    {
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
     }
 };
 
+/* In previous versions of this code, signatureCache was a local static variable
+ * in CachingTransactionSignatureChecker::VerifySignature.  We initialize
+ * signatureCache outside of VerifySignature to avoid the atomic operation per
+ * call overhead associated with local static variables even though
+ * signatureCache could be made local to VerifySignature.
+*/
+static CSignatureCache signatureCache;
+static size_t nSignatureCacheBytes = 0;
+static uint32_t nSignatureCacheElements = 0;
+}
+
+void InitSignatureCache()
+{
+    // nMaxCacheSize is unsigned. If the size is set to zero, setup_bytes
+    // creates the minimum possible cache (2 elements).
+    int64_t nMaxCacheSizeMiB = std::min(std::max((int64_t)0, GetArg("-sigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE);
+    size_t nMaxCacheSize = nMaxCacheSizeMiB * ((size_t)1 << 20);
+    if (mapArgs.count("-maxsigcachesize") && !mapArgs.count("-sigcachesize")) {
+        // Legacy option: a number of entries, each now taking one uint256
+        int64_t nEntries = std::max((int64_t)0, GetArg("-maxsigcachesize", 0));
+        nMaxCacheSize = std::min(nEntries, (MAX_MAX_SIG_CACHE_SIZE << 20) / (int64_t)sizeof(uint256)) * sizeof(uint256);
+    }
+    nSignatureCacheElements = signatureCache.setup_bytes(nMaxCacheSize);
+    nSignatureCacheBytes = nMaxCacheSize;
+    LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
+              (nSignatureCacheElements * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nSignatureCacheElements);
+}
+
+void GetSignatureCacheStats(uint64_t& nHits, uint64_t& nMisses, size_t& nBytes, uint32_t& nElements)
+{
+    signatureCache.GetStats(nHits, nMisses);
+    nBytes = nSignatureCacheBytes;
+    nElements = nSignatureCacheElements;
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // Signatures checked again while connecting a block won't be needed afterwards
+    if (signatureCache.Get(entry, !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
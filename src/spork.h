@@ -64,6 +64,8 @@ class CSporkManager;
 
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
+/** Guards mapSporks and mapSporksActive; nothing else is locked while holding it */
+extern CCriticalSection cs_mapSporks;
 extern CSporkManager sporkManager;
 
 void LoadSporksFromDB();
@@ -34,6 +34,7 @@ using namespace libzerocoin;
 #define COLOR_STR_RED     "\033[31m"
 
 #define TESTS_COINS_TO_ACCUMULATE   50
+#define TESTS_MULTIEXP_ROUNDS       20
 
 // Global test counters
 uint32_t    ggNumTests        = 0;
@@ -369,6 +370,50 @@ Testb_MintAndSpend()
     return false;
 }
 
+bool
+Testb_VerifyMultiExp()
+{
+    // The products checked by the proof verifiers, computed term by term as
+    // the verifiers used to and as one multi-exponentiation
+    const IntegerGroupParams& sokGroup = gg_Params->serialNumberSoKCommitmentGroup;
+    const IntegerGroupParams& qrnGroup = gg_Params->accumulatorParams.accumulatorQRNCommitmentGroup;
+    const CBigNum& qrnModulus = gg_Params->accumulatorParams.accumulatorModulus;
+    vector<CBigNum> vSoKBases, vSoKExps, vSoKH;
+    vector<CBigNum> vQRNBases, vQRNExps, vQRNH;
+    for (uint32_t i = 0; i < TESTS_MULTIEXP_ROUNDS; i++) {
+        // V^exp * h^s' of SerialNumberSignatureOfKnowledge::Verify
+        vSoKBases.push_back(CBigNum::randBignum(sokGroup.modulus));
+        vSoKExps.push_back(CBigNum::randBignum(sokGroup.groupOrder));
+        vSoKH.push_back(CBigNum::randBignum(sokGroup.groupOrder));
+        // A^c * C_u^s_alpha * h^-s_beta of AccumulatorProofOfKnowledge::Verify
+        vQRNBases.push_back(CBigNum::randBignum(qrnModulus));
+        vQRNBases.push_back(CBigNum::randBignum(qrnModulus));
+        vQRNExps.push_back(CBigNum::RandKBitBigum(256));
+        vQRNExps.push_back(CBigNum::RandKBitBigum(1312));
+        vQRNH.push_back(CBigNum::RandKBitBigum(3321) * -1);
+    }
+
+    vector<CBigNum> vTermByTerm, vMultiExp;
+    timer.start();
+    for (uint32_t i = 0; i < TESTS_MULTIEXP_ROUNDS; i++) {
+        vTermByTerm.push_back(vSoKBases[i].pow_mod(vSoKExps[i], sokGroup.modulus).mul_mod(sokGroup.h.pow_mod(vSoKH[i], sokGroup.modulus), sokGroup.modulus));
+        vTermByTerm.push_back(vQRNBases[2 * i].pow_mod(vQRNExps[2 * i], qrnModulus).mul_mod(vQRNBases[2 * i + 1].pow_mod(vQRNExps[2 * i + 1], qrnModulus), qrnModulus).mul_mod(qrnGroup.h.pow_mod(vQRNH[i], qrnModulus), qrnModulus));
+    }
+    timer.stop();
+    cout << "\tVERIFY TERM BY TERM ELAPSED TIME: " << timer.duration() << " ms\t" << timer.duration()*0.001 << " s" << endl;
+
+    timer.start();
+    for (uint32_t i = 0; i < TESTS_MULTIEXP_ROUNDS; i++) {
+        vMultiExp.push_back(sokGroup.arithmetic().multiExp(vector<CBigNum>(1, vSoKBases[i]), vector<CBigNum>(1, vSoKExps[i]), CBigNum(0), vSoKH[i]));
+        vMultiExp.push_back(qrnGroup.arithmetic().multiExp(vector<CBigNum>(vQRNBases.begin() + 2 * i, vQRNBases.begin() + 2 * i + 2),
+                                                            vector<CBigNum>(vQRNExps.begin() + 2 * i, vQRNExps.begin() + 2 * i + 2), CBigNum(0), vQRNH[i]));
+    }
+    timer.stop();
+    cout << "\tVERIFY MULTI-EXP ELAPSED TIME: " << timer.duration() << " ms\t" << timer.duration()*0.001 << " s" << endl;
+
+    return vTermByTerm == vMultiExp;
+}
+
 void
 Testb_RunAllTests()
 {
@@ -388,6 +433,7 @@ Testb_RunAllTests()
     gLogTestResult("coins can be minted", Testb_MintCoin);
     gLogTestResult("the accumulator works", Testb_Accumulator);
     gLogTestResult("a minted coin can be spent", Testb_MintAndSpend);
+    gLogTestResult("multi-exponentiation matches the term by term products", Testb_VerifyMultiExp);
 
     // Summarize test results
     if (ggSuccessfulTests < ggNumTests) {
@@ -0,0 +1,130 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "main.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(3);
+    block.vtx[0] = tx;
+    block.nVersion = 1;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    block.vtx[1] = tx;
+
+    tx.vin.resize(10);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout.hash = GetRandHash();
+        tx.vin[i].prevout.n = 0;
+    }
+    block.vtx[2] = tx;
+
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblockOut;
+    stream >> cmpctblockOut;
+    BOOST_CHECK(stream.empty());
+    return cmpctblockOut;
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_serialization)
+{
+    CBlock block = BuildBlockTestCase();
+    CBlockHeaderAndShortTxIDs cmpctblock(block);
+    BOOST_CHECK_EQUAL(cmpctblock.prefilledtxn.size(), 1);
+    BOOST_CHECK_EQUAL(cmpctblock.shorttxids.size(), 2);
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+
+    CBlockHeaderAndShortTxIDs cmpctblockOut = RoundTrip(cmpctblock);
+    BOOST_CHECK(cmpctblockOut.header.GetHash() == block.GetHash());
+    BOOST_CHECK(cmpctblockOut.shorttxids == cmpctblock.shorttxids);
+    BOOST_CHECK(cmpctblockOut.prefilledtxn[0].tx.GetHash() == block.vtx[0].GetHash());
+    // The short id keys are derived again on the receiving side
+    BOOST_CHECK_EQUAL(cmpctblockOut.GetShortID(block.vtx[1].GetHash()), cmpctblock.GetShortID(block.vtx[1].GetHash()));
+    BOOST_CHECK_EQUAL(cmpctblock.GetShortID(block.vtx[1].GetHash()) >> 48, 0);
+
+    // Short ids are 6 bytes on the wire
+    BOOST_CHECK_EQUAL(CShortTxIDs(cmpctblock.shorttxids).GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION), 1 + 2 * 6);
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_reconstruction)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+    pool.addUnchecked(block.vtx[2].GetHash(), CTxMemPoolEntry(block.vtx[2], 0, 0, 0.0, 1));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK_EQUAL(partialBlock.InitData(cmpctblock, pool), READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 1);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 1);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+
+    std::vector<uint32_t> vMissing;
+    partialBlock.GetMissing(vMissing);
+    BOOST_CHECK_EQUAL(vMissing.size(), 1);
+    BOOST_CHECK_EQUAL(vMissing[0], 1);
+
+    // A wrong transaction does not match the merkle root
+    PartiallyDownloadedBlock partialBlockWrong = partialBlock;
+    CBlock blockOut;
+    BOOST_CHECK_EQUAL(partialBlockWrong.FillBlock(blockOut, std::vector<CTransaction>(1, block.vtx[2])), READ_STATUS_FAILED);
+
+    // Too few transactions is a malformed reply
+    PartiallyDownloadedBlock partialBlockShort = partialBlock;
+    BOOST_CHECK_EQUAL(partialBlockShort.FillBlock(blockOut, std::vector<CTransaction>()), READ_STATUS_INVALID);
+
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockOut, std::vector<CTransaction>(1, block.vtx[1])), READ_STATUS_OK);
+    BOOST_CHECK(blockOut.GetHash() == block.GetHash());
+    BOOST_CHECK(blockOut.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_invalid)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+
+    // A prefilled index past the end of the block
+    CBlockHeaderAndShortTxIDs cmpctblock(block);
+    cmpctblock.prefilledtxn[0].index = block.vtx.size();
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK_EQUAL(partialBlock.InitData(RoundTrip(cmpctblock), pool), READ_STATUS_INVALID);
+
+    // Two short ids of the block collide, only the full block tells them apart
+    CBlockHeaderAndShortTxIDs cmpctblockCollision(block);
+    cmpctblockCollision.shorttxids[1] = cmpctblockCollision.shorttxids[0];
+    PartiallyDownloadedBlock partialBlockCollision;
+    BOOST_CHECK_EQUAL(partialBlockCollision.InitData(RoundTrip(cmpctblockCollision), pool), READ_STATUS_FAILED);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
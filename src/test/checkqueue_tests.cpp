@@ -0,0 +1,110 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** Counts its runs, and fails if it was created to */
+class CCountingCheck
+{
+private:
+    std::atomic<int>* pnRuns;
+    bool fOk;
+
+public:
+    CCountingCheck() : pnRuns(NULL), fOk(true) {}
+    CCountingCheck(std::atomic<int>* pnRunsIn, bool fOkIn) : pnRuns(pnRunsIn), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        ++*pnRuns;
+        return fOk;
+    }
+
+    void swap(CCountingCheck& check)
+    {
+        std::swap(pnRuns, check.pnRuns);
+        std::swap(fOk, check.fOk);
+    }
+};
+
+/** Queue nChecks in small batches on queue and wait for them, as a master does */
+void RunMaster(CCheckQueue<CCountingCheck>* pqueue, std::atomic<int>* pnRuns, int nChecks, int nFailAt, bool* pfResult)
+{
+    CCheckQueueControl<CCountingCheck> control(pqueue);
+    for (int i = 0; i < nChecks; i += 10) {
+        std::vector<CCountingCheck> vChecks;
+        for (int j = i; j < i + 10 && j < nChecks; j++)
+            vChecks.push_back(CCountingCheck(pnRuns, j != nFailAt));
+        control.Add(vChecks);
+    }
+    *pfResult = control.Wait();
+}
+}
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_shared_host)
+{
+    CCheckQueueHost host;
+    CCheckQueue<CCountingCheck> queueA(16, &host);
+    CCheckQueue<CCountingCheck> queueB(4, &host);
+    boost::thread_group workers;
+    for (int i = 0; i < 3; i++)
+        workers.create_thread(boost::bind(&CCheckQueueHost::Thread, &host));
+
+    for (int nRound = 0; nRound < 50; nRound++) {
+        std::atomic<int> nRunsA(0), nRunsB(0);
+        bool fResultA = false, fResultB = false;
+        // Both queues are driven at the same time, by their own master
+        boost::thread masterA(boost::bind(&RunMaster, &queueA, &nRunsA, 1000, -1, &fResultA));
+        boost::thread masterB(boost::bind(&RunMaster, &queueB, &nRunsB, 300, -1, &fResultB));
+        masterA.join();
+        masterB.join();
+        BOOST_CHECK(fResultA && fResultB);
+        BOOST_CHECK_EQUAL(nRunsA, 1000);
+        BOOST_CHECK_EQUAL(nRunsB, 300);
+        BOOST_CHECK(queueA.IsIdle() && queueB.IsIdle());
+    }
+
+    // A failing check fails only its own queue, and each queue is reset afterwards
+    std::atomic<int> nRunsA(0), nRunsB(0);
+    bool fResultA = true, fResultB = false;
+    boost::thread masterA(boost::bind(&RunMaster, &queueA, &nRunsA, 1000, 500, &fResultA));
+    boost::thread masterB(boost::bind(&RunMaster, &queueB, &nRunsB, 300, -1, &fResultB));
+    masterA.join();
+    masterB.join();
+    BOOST_CHECK(!fResultA);
+    BOOST_CHECK(fResultB);
+    BOOST_CHECK(queueA.IsIdle());
+    RunMaster(&queueA, &nRunsA, 10, -1, &fResultA);
+    BOOST_CHECK(fResultA);
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_host_without_workers)
+{
+    // The master alone processes everything
+    CCheckQueueHost host;
+    CCheckQueue<CCountingCheck> queue(16, &host);
+    std::atomic<int> nRuns(0);
+    bool fResult = false;
+    RunMaster(&queue, &nRuns, 100, -1, &fResult);
+    BOOST_CHECK(fResult);
+    BOOST_CHECK_EQUAL(nRuns, 100);
+    RunMaster(&queue, &nRuns, 100, 7, &fResult);
+    BOOST_CHECK(!fResult);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,12 +4,15 @@
 
 #include "coins.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 
 #include <vector>
 #include <map>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace
 {
@@ -58,6 +61,96 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewCacheTest : public CCoinsViewCache
+{
+public:
+    CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+
+    const CCoinsMap& Map() const { return cacheCoins; }
+
+    // DynamicMemoryUsage computed from scratch instead of from the running total
+    size_t RecomputeDynamicMemoryUsage() const
+    {
+        size_t nUsage = cacheCoins.DynamicMemoryUsage();
+        for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++)
+            nUsage += it->second.DynamicMemoryUsage();
+        return nUsage;
+    }
+};
+
+// In-memory coin database whose writes wait until Release, so that tests can
+// look at CCoinsViewAsyncFlush while its snapshots are pending.
+class CCoinsViewDBBlocking : public CCoinsViewDB
+{
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fBlocked;
+
+public:
+    const CCoinsViewAsyncFlush* pflush;
+    std::vector<unsigned int> vPendingAtCommit; //!< snapshots queued in pflush right after each write committed
+
+    CCoinsViewDBBlocking() : CCoinsViewDB(1 << 20, true), fBlocked(true), pflush(NULL) {}
+
+    void Release()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fBlocked = false;
+        }
+        cond.notify_all();
+    }
+
+    bool WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock, size_t* pnBytes)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fBlocked)
+                cond.wait(lock);
+        }
+        bool fOk = CCoinsViewDB::WriteCoins(mapCoins, hashBlock, pnBytes);
+        if (pflush) {
+            CCoinsFlushStats stats;
+            pflush->GetFlushStats(stats);
+            vPendingAtCommit.push_back(stats.nPending);
+        }
+        return fOk;
+    }
+};
+
+void AddCoins(CCoinsViewCache& cache, const uint256& txid, int nHeight, unsigned int nOutputs)
+{
+    CCoinsModifier coins = cache.ModifyCoins(txid);
+    coins->nVersion = 1;
+    coins->nHeight = nHeight;
+    coins->vout.clear();
+    for (unsigned int i = 0; i < nOutputs; i++)
+        coins->vout.push_back(CTxOut(nHeight * 10 + i + 1, CScript() << OP_TRUE));
+}
+
+// Whether two views agree on the unspent outputs of txid; pruned and missing
+// entries are the same to a reader.
+bool SameCoins(const CCoinsView& viewA, const CCoinsView& viewB, const uint256& txid)
+{
+    CCoins coinsA, coinsB;
+    bool fHaveA = viewA.GetCoins(txid, coinsA) && !coinsA.IsPruned();
+    bool fHaveB = viewB.GetCoins(txid, coinsB) && !coinsB.IsPruned();
+    if (fHaveA != fHaveB)
+        return false;
+    if (!fHaveA)
+        return true;
+    if (coinsA.nHeight != coinsB.nHeight)
+        return false;
+    for (unsigned int i = 0; i < std::max(coinsA.vout.size(), coinsB.vout.size()); i++) {
+        bool fAvailableA = coinsA.IsAvailable(i);
+        if (fAvailableA != coinsB.IsAvailable(i))
+            return false;
+        if (fAvailableA && coinsA.vout[i] != coinsB.vout[i])
+            return false;
+    }
+    return true;
+}
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -175,4 +268,175 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Only outputs that were spent or created are reported as modified to the
+// backing view, across a stack of caches.
+BOOST_AUTO_TEST_CASE(coins_modified_outputs)
+{
+    CCoinsViewTest base;
+    uint256 txid = GetRandHash();
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 100;
+    for (int i = 0; i < 10; i++)
+        coins.vout.push_back(CTxOut(i + 1, CScript() << OP_TRUE));
+    CCoinsMap mapBase;
+    mapBase[txid].coins = coins;
+    mapBase[txid].flags = CCoinsCacheEntry::DIRTY;
+    base.BatchWrite(mapBase, uint256(1));
+
+    CCoinsViewCacheTest tip(&base);
+    {
+        CCoinsViewCache child(&tip);
+        child.ModifyCoins(txid)->Spend(3);
+        BOOST_CHECK(child.Flush());
+    }
+    tip.ModifyCoins(txid)->Spend(9);
+    tip.ModifyCoins(txid);
+
+    const CCoinsMap& mapTip = tip.Map();
+    CCoinsMap::const_iterator it = mapTip.find(txid);
+    BOOST_CHECK(it != mapTip.end());
+    const std::vector<bool>& vModified = it->second.vModified;
+    for (unsigned int i = 0; i < vModified.size(); i++)
+        BOOST_CHECK_EQUAL(vModified[i], i == 3 || i == 9);
+    // The trailing spent output was dropped from vout, but is still reported
+    BOOST_CHECK_EQUAL(vModified.size(), 10U);
+    BOOST_CHECK_EQUAL(it->second.coins.vout.size(), 9U);
+
+    // The modified flags count towards the cache size
+    BOOST_CHECK_EQUAL(tip.DynamicMemoryUsage(), tip.RecomputeDynamicMemoryUsage());
+    BOOST_CHECK(tip.DynamicMemoryUsage() > mapTip.DynamicMemoryUsage() + it->second.coins.DynamicMemoryUsage());
+}
+
+// Prefetched coins behave like coins fetched on a cache miss: they are
+// clean, and never replace an entry the cache already holds.
+BOOST_AUTO_TEST_CASE(coins_prefetch)
+{
+    CCoinsViewTest base;
+    uint256 txid = GetRandHash();
+    CCoinsMap mapBase;
+    mapBase[txid].coins.nVersion = 1;
+    mapBase[txid].coins.vout.push_back(CTxOut(5, CScript() << OP_TRUE));
+    mapBase[txid].flags = CCoinsCacheEntry::DIRTY;
+    base.BatchWrite(mapBase, uint256(1));
+
+    CCoinsViewCacheTest tip(&base);
+    BOOST_CHECK(!tip.HaveCoinsInCache(txid));
+    CCoins coins;
+    BOOST_CHECK(tip.GetBackend()->GetCoins(txid, coins));
+    tip.AddPrefetchedCoins(txid, coins);
+    BOOST_CHECK(tip.HaveCoinsInCache(txid));
+    BOOST_CHECK_EQUAL(tip.Map().find(txid)->second.flags, 0);
+
+    tip.ModifyCoins(txid)->Spend(0);
+    CCoins stale;
+    stale.nVersion = 1;
+    stale.vout.push_back(CTxOut(5, CScript() << OP_TRUE));
+    tip.AddPrefetchedCoins(txid, stale);
+    BOOST_CHECK(tip.AccessCoins(txid)->IsPruned());
+}
+
+// Reads through CCoinsViewAsyncFlush see the newest pending snapshot, and a
+// snapshot stays readable until the database has committed its batch.
+BOOST_AUTO_TEST_CASE(coins_async_flush_pending)
+{
+    CCoinsViewDBBlocking db;
+    CCoinsViewAsyncFlush flush(&db, 2);
+    db.pflush = &flush;
+    uint256 txid = GetRandHash();
+    uint256 txid2 = GetRandHash();
+
+    {
+        CCoinsViewCache cache(&flush);
+        AddCoins(cache, txid, 1, 2);
+        AddCoins(cache, txid2, 2, 1);
+        cache.SetBestBlock(uint256(1));
+        BOOST_CHECK(cache.Flush());
+        // Loaded from the pending snapshot
+        cache.ModifyCoins(txid)->Spend(0);
+        cache.SetBestBlock(uint256(2));
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsFlushStats stats;
+    flush.GetFlushStats(stats);
+    BOOST_CHECK_EQUAL(stats.nPending, 2U);
+    BOOST_CHECK(flush.PendingMemoryUsage() > 0);
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.HaveCoins(txid2));
+
+    CCoins coins;
+    BOOST_CHECK(flush.GetCoins(txid, coins));
+    BOOST_CHECK(!coins.IsAvailable(0));
+    BOOST_CHECK(coins.IsAvailable(1));
+    BOOST_CHECK(flush.HaveCoins(txid2));
+    BOOST_CHECK(flush.GetBestBlock() == uint256(2));
+    {
+        CCoinsViewCache cache(&flush);
+        BOOST_CHECK(cache.HaveCoins(txid2));
+        BOOST_CHECK(cache.AccessCoins(txid)->IsAvailable(1));
+        BOOST_CHECK(!cache.AccessCoins(txid)->IsAvailable(0));
+    }
+
+    db.Release();
+    BOOST_CHECK(flush.Sync());
+    BOOST_CHECK_EQUAL(db.vPendingAtCommit.size(), 2U);
+    BOOST_CHECK_EQUAL(db.vPendingAtCommit[0], 2U);
+    BOOST_CHECK_EQUAL(db.vPendingAtCommit[1], 1U);
+
+    flush.GetFlushStats(stats);
+    BOOST_CHECK_EQUAL(stats.nPending, 0U);
+    BOOST_CHECK_EQUAL(stats.nFlushes, 2U);
+    BOOST_CHECK_EQUAL(flush.PendingMemoryUsage(), 0U);
+    BOOST_CHECK(db.GetCoins(txid, coins));
+    BOOST_CHECK(!coins.IsAvailable(0));
+    BOOST_CHECK(coins.IsAvailable(1));
+    BOOST_CHECK(db.HaveCoins(txid2));
+    BOOST_CHECK(db.GetBestBlock() == uint256(2));
+}
+
+// Random flushes through CCoinsViewAsyncFlush read back the same as
+// synchronous writes to a CCoinsViewDB, before and after the snapshots land.
+BOOST_AUTO_TEST_CASE(coins_async_flush_matches_sync)
+{
+    CCoinsViewDB dbAsync(1 << 20, true);
+    CCoinsViewDB dbSync(1 << 20, true);
+    CCoinsViewAsyncFlush flush(&dbAsync, 2);
+    CCoinsViewCache cacheAsync(&flush);
+    CCoinsViewCache cacheSync(&dbSync);
+
+    std::vector<uint256> txids;
+    for (int i = 0; i < 64; i++)
+        txids.push_back(GetRandHash());
+
+    for (int nStep = 1; nStep <= 4000; nStep++) {
+        const uint256& txid = txids[insecure_rand() % txids.size()];
+        const CCoins* coins = cacheSync.AccessCoins(txid);
+        if (!coins || coins->IsPruned()) {
+            unsigned int nOutputs = 1 + insecure_rand() % 4;
+            AddCoins(cacheAsync, txid, nStep, nOutputs);
+            AddCoins(cacheSync, txid, nStep, nOutputs);
+        } else {
+            unsigned int nOutput = insecure_rand() % coins->vout.size();
+            cacheAsync.ModifyCoins(txid)->Spend(nOutput);
+            cacheSync.ModifyCoins(txid)->Spend(nOutput);
+        }
+
+        if (nStep % 50 == 0) {
+            cacheAsync.SetBestBlock(uint256(nStep));
+            cacheSync.SetBestBlock(uint256(nStep));
+            BOOST_CHECK(cacheAsync.Flush());
+            BOOST_CHECK(cacheSync.Flush());
+            BOOST_CHECK(flush.GetBestBlock() == dbSync.GetBestBlock());
+            for (unsigned int i = 0; i < txids.size(); i++)
+                BOOST_CHECK(SameCoins(flush, dbSync, txids[i]));
+        }
+    }
+
+    BOOST_CHECK(flush.Sync());
+    BOOST_CHECK(dbAsync.GetBestBlock() == dbSync.GetBestBlock());
+    for (unsigned int i = 0; i < txids.size(); i++)
+        BOOST_CHECK(SameCoins(dbAsync, dbSync, txids[i]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
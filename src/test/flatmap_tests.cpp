@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flatmap.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+class TestHasher
+{
+public:
+    // Use few distinct hashes so long probe chains and tombstones get exercised
+    size_t operator()(const uint256& key) const { return key.GetLow64() % 61; }
+};
+
+typedef flatmap<uint256, int, TestHasher> testmap;
+
+void CheckEqual(const testmap& m, const std::map<uint256, int>& ref)
+{
+    BOOST_CHECK_EQUAL(m.size(), ref.size());
+    size_t nCount = 0;
+    for (testmap::const_iterator it = m.begin(); it != m.end(); ++it) {
+        std::map<uint256, int>::const_iterator itRef = ref.find(it->first);
+        BOOST_CHECK(itRef != ref.end() && itRef->second == it->second);
+        nCount++;
+    }
+    BOOST_CHECK_EQUAL(nCount, ref.size());
+}
+}
+
+BOOST_AUTO_TEST_SUITE(flatmap_tests)
+
+BOOST_AUTO_TEST_CASE(flatmap_like_map)
+{
+    testmap m;
+    std::map<uint256, int> ref;
+    std::vector<uint256> keys;
+    for (int i = 0; i < 500; i++)
+        keys.push_back(GetRandHash());
+
+    for (int i = 0; i < 20000; i++) {
+        const uint256& key = keys[insecure_rand() % keys.size()];
+        switch (insecure_rand() % 4) {
+        case 0:
+        case 1: {
+            std::pair<testmap::iterator, bool> ret = m.insert(std::make_pair(key, i));
+            BOOST_CHECK_EQUAL(ret.second, ref.insert(std::make_pair(key, i)).second);
+            BOOST_CHECK(ret.first->first == key);
+            break;
+        }
+        case 2:
+            m[key] = i;
+            ref[key] = i;
+            break;
+        case 3:
+            BOOST_CHECK_EQUAL(m.erase(key), ref.erase(key));
+            break;
+        }
+        BOOST_CHECK_EQUAL(m.count(key), ref.count(key));
+    }
+    CheckEqual(m, ref);
+
+    m.clear();
+    BOOST_CHECK(m.empty());
+    BOOST_CHECK(m.begin() == m.end());
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_erase_while_iterating)
+{
+    testmap m;
+    std::map<uint256, int> ref;
+    for (int i = 0; i < 1000; i++) {
+        uint256 key = GetRandHash();
+        m[key] = i;
+        ref[key] = i;
+    }
+    // Erase every odd value while iterating, as CCoinsViewDB::BatchWrite does
+    for (testmap::iterator it = m.begin(); it != m.end();) {
+        if (it->second % 2) {
+            ref.erase(it->first);
+            m.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    CheckEqual(m, ref);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_stable_references)
+{
+    testmap m;
+    uint256 first = GetRandHash();
+    int* pValue = &m[first];
+    *pValue = 42;
+    // Growing the table must not move existing elements
+    for (int i = 0; i < 10000; i++)
+        m[GetRandHash()] = i;
+    BOOST_CHECK(pValue == &m.find(first)->second);
+    BOOST_CHECK_EQUAL(*pValue, 42);
+    BOOST_CHECK(m.DynamicMemoryUsage() > m.size() * sizeof(testmap::value_type));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
 #include "utilstrencodings.h"
 
 #include <vector>
@@ -46,4 +48,34 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // Test vector of the SipHash reference implementation: key 00..0f, message 00..1f
+    uint256 x("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, x), 0x7127512f72f27cceULL);
+    BOOST_CHECK(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, uint256(1)) != SipHashUint256(0, 0, uint256(1)));
+}
+
+BOOST_AUTO_TEST_CASE(header_hash_batch)
+{
+    // Enough headers to exercise the threaded path, mixing Quark and SHA256d versions
+    std::vector<CBlockHeader> vHeaders(2000);
+    for (unsigned int i = 0; i < vHeaders.size(); i++) {
+        vHeaders[i].nVersion = (i % 3 == 0) ? CBlockHeader::VERSION5 : CBlockHeader::VERSION4;
+        vHeaders[i].hashPrevBlock = GetRandHash();
+        vHeaders[i].nTime = i;
+        vHeaders[i].nNonce = insecure_rand();
+    }
+
+    std::vector<uint256> vHashes;
+    GetBlockHeaderHashes(vHeaders, vHashes);
+    BOOST_CHECK_EQUAL(vHashes.size(), vHeaders.size());
+    for (unsigned int i = 0; i < vHeaders.size(); i++)
+        BOOST_CHECK(vHashes[i] == vHeaders[i].GetHash());
+
+    std::vector<CBlockHeader> vEmpty;
+    GetBlockHeaderHashes(vEmpty, vHashes);
+    BOOST_CHECK(vHashes.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "random.h"
+
+#include <deque>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+// The prepared kernel must hash and compare exactly like the serialized one
+// used by consensus code.
+BOOST_AUTO_TEST_CASE(stake_kernel_prepared)
+{
+    for (int i = 0; i < 100; i++) {
+        uint64_t nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        unsigned int nTimeBlockFrom = 1500000000 + GetRand(100000000);
+        COutPoint prevout(GetRandHash(), GetRand(100));
+        int64_t nValueIn = GetRand(100000 * COIN);
+        // Easy targets, so that both hits and misses occur
+        unsigned int nBits = i % 2 ? 0x207fffff : 0x1e0ffff0;
+
+        CStakeKernel kernel(nStakeModifier, nTimeBlockFrom, prevout, nValueIn, nBits);
+        CDataStream ss(SER_GETHASH, 0);
+        ss << nStakeModifier;
+        uint256 bnTargetPerCoinDay;
+        bnTargetPerCoinDay.SetCompact(nBits);
+        for (unsigned int nTimeTx = nTimeBlockFrom; nTimeTx < nTimeBlockFrom + 10; nTimeTx++) {
+            uint256 hashExpected = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+            uint256 hashProofOfStake;
+            BOOST_CHECK_EQUAL(kernel.CheckHash(nTimeTx, hashProofOfStake), stakeTargetHit(hashExpected, nValueIn, bnTargetPerCoinDay));
+            BOOST_CHECK(hashProofOfStake == hashExpected);
+        }
+    }
+}
+
+static const int64_t nTestSelectionInterval = 2000;
+
+// The walk GetKernelStakeModifier does without the index
+static const CBlockIndex* WalkKernelModifierBlock(const CChain& chain, const CBlockIndex* pindexFrom)
+{
+    int64_t nModifierTime = pindexFrom->GetBlockTime();
+    const CBlockIndex* pindex = pindexFrom;
+    while (nModifierTime < pindexFrom->GetBlockTime() + nTestSelectionInterval) {
+        pindex = chain[pindex->nHeight + 1];
+        if (!pindex)
+            return NULL;
+        if (pindex->GeneratedStakeModifier())
+            nModifierTime = pindex->GetBlockTime();
+    }
+    return pindex;
+}
+
+static const CBlockIndex* WalkLastModifierBlock(const CBlockIndex* pindex)
+{
+    while (pindex->pprev && !pindex->GeneratedStakeModifier())
+        pindex = pindex->pprev;
+    return pindex->GeneratedStakeModifier() ? pindex : NULL;
+}
+
+static void ExtendChain(std::deque<CBlockIndex>& blocks, CBlockIndex* pprev, int nBlocks)
+{
+    for (int i = 0; i < nBlocks; i++) {
+        blocks.push_back(CBlockIndex());
+        CBlockIndex* pindex = &blocks.back();
+        pindex->pprev = pprev;
+        pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+        // Mostly increasing, but out of order timestamps occur
+        pindex->nTime = (pprev ? pprev->nTime : 1500000000) + (int)GetRand(240) - 60;
+        pindex->SetStakeModifier(pindex->nHeight, !pprev || GetRand(3) == 0);
+        pprev = pindex;
+    }
+}
+
+static void CheckModifierIndex(const CChain& chain, const CStakeModifierIndex& index)
+{
+    for (int nHeight = 0; nHeight <= chain.Height(); nHeight++) {
+        BOOST_CHECK(index.GetKernelModifierBlock(chain[nHeight]) == WalkKernelModifierBlock(chain, chain[nHeight]));
+        BOOST_CHECK(index.GetLastModifierBlock(chain[nHeight]) == WalkLastModifierBlock(chain[nHeight]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_index)
+{
+    std::deque<CBlockIndex> blocks;
+    CChain chain;
+    CStakeModifierIndex index(nTestSelectionInterval);
+
+    ExtendChain(blocks, NULL, 500);
+    chain.SetTip(&blocks.back());
+    index.Sync(chain);
+    CheckModifierIndex(chain, index);
+
+    // Grow the tip one block at a time
+    for (int i = 0; i < 50; i++) {
+        ExtendChain(blocks, chain.Tip(), 1);
+        chain.SetTip(&blocks.back());
+        index.Sync(chain);
+        CheckModifierIndex(chain, index);
+    }
+
+    // Reorganize to a longer fork and back to the original chain
+    CBlockIndex* pindexOriginal = chain.Tip();
+    const CBlockIndex* pindexStale = chain[490];
+    ExtendChain(blocks, chain[480], 100);
+    chain.SetTip(&blocks.back());
+    index.Sync(chain);
+    CheckModifierIndex(chain, index);
+    BOOST_CHECK(index.GetKernelModifierBlock(pindexStale) == NULL);
+
+    chain.SetTip(pindexOriginal);
+    index.Sync(chain);
+    CheckModifierIndex(chain, index);
+
+    // A shorter chain
+    chain.SetTip(chain[100]);
+    index.Sync(chain);
+    CheckModifierIndex(chain, index);
+
+    index.Clear();
+    BOOST_CHECK(index.GetKernelModifierBlock(chain[10]) == NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
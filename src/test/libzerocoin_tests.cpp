@@ -23,6 +23,7 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
 #include "libzerocoin/Accumulator.h"
+#include "libzerocoin/Montgomery.h"
 
 using namespace std;
 using namespace libzerocoin;
@@ -489,4 +490,115 @@ BOOST_AUTO_TEST_CASE(libzerocoin_tests)
     
     Test_RunAllTests();
 }
+
+static CBigNum RandomOddModulus(uint32_t nBits)
+{
+    CBigNum m = CBigNum::RandKBitBigum(nBits - 1) + (CBigNum(1) << (nBits - 1));
+    if (m % CBigNum(2) == CBigNum(0))
+        m += CBigNum(1);
+    return m;
+}
+
+BOOST_AUTO_TEST_CASE(montgomery_tests)
+{
+    // widths of the zerocoin groups and the accumulator, up to the widest supported modulus
+    const uint32_t vModulusBits[] = {257, 556, 1024, 1033, 2048, 3072};
+    for (uint32_t nBits : vModulusBits) {
+        CBigNum m = RandomOddModulus(nBits);
+        MontgomeryContext ctx(m);
+
+        for (int i = 0; i < 8; i++) {
+            CBigNum a = CBigNum::randBignum(m);
+            CBigNum b = CBigNum::randBignum(m);
+            BOOST_CHECK(ctx.mul_mod(a, b) == a.mul_mod(b, m));
+            BOOST_CHECK(ctx.mul_mod(a * b + m, b) == (a * b).mul_mod(b, m));
+
+            CBigNum e = CBigNum::RandKBitBigum(1 + i * nBits / 4);
+            BOOST_CHECK(ctx.pow_mod(a, e) == a.pow_mod(e, m));
+        }
+        CBigNum a = CBigNum::randBignum(m);
+        BOOST_CHECK(ctx.pow_mod(a, CBigNum(0)) == CBigNum(1));
+        BOOST_CHECK(ctx.pow_mod(a, CBigNum(1)) == a);
+        BOOST_CHECK(ctx.pow_mod(CBigNum(0), CBigNum(5)) == CBigNum(0));
+        BOOST_CHECK(ctx.pow_mod(m - CBigNum(1), CBigNum(2)) == CBigNum(1));
+
+        // fixed-base exponents within the table, wider than the table and negative
+        CBigNum g = CBigNum::randBignum(m);
+        FixedBaseTable table(ctx, g, 256);
+        for (uint32_t nExpBits : {1, 4, 255, 256, 257, 1024}) {
+            CBigNum e = CBigNum::RandKBitBigum(nExpBits);
+            BOOST_CHECK(table.pow_mod(e) == g.pow_mod(e, m));
+        }
+        BOOST_CHECK(table.pow_mod(CBigNum(0)) == CBigNum(1));
+    }
+
+    BOOST_CHECK_THROW(MontgomeryContext(CBigNum(1) << 100), std::runtime_error);
+    BOOST_CHECK_THROW(MontgomeryContext(RandomOddModulus(MONT_MAX_BITS + 1)), std::runtime_error);
+
+    // negative exponents need an invertible base, use a prime modulus
+    CBigNum p = CBigNum::generatePrime(1024, false);
+    CBigNum g = CBigNum::randBignum(p - CBigNum(2)) + CBigNum(2);
+    CBigNum h = CBigNum::randBignum(p - CBigNum(2)) + CBigNum(2);
+    CBigNum e1 = CBigNum::RandKBitBigum(300);
+    CBigNum e2 = CBigNum::RandKBitBigum(200);
+    MontgomeryContext ctx(p);
+    BOOST_CHECK(ctx.pow_mod(g, e1 * -1) == g.pow_mod(e1 * -1, p));
+    BOOST_CHECK(FixedBaseTable(ctx, g, 256).pow_mod(e2 * -1) == g.pow_mod(e2 * -1, p));
+
+    // the group arithmetic of either backend matches the OpenSSL operations
+    GroupArithmetic arith(p, g, h, CBigNum(0));
+    BOOST_CHECK(arith.powG(e2) == g.pow_mod(e2, p));
+    BOOST_CHECK(arith.powH(e1) == h.pow_mod(e1, p));
+    BOOST_CHECK(arith.powGH(e1, e2 * -1) == g.pow_mod(e1, p).mul_mod(h.pow_mod(e2 * -1, p), p));
+    BOOST_CHECK(arith.pow_mod(h, e1) == h.pow_mod(e1, p));
+    BOOST_CHECK(arith.mul_mod(g, h) == g.mul_mod(h, p));
+
+    // a claimed order that g and h do not have is ignored
+    GroupArithmetic arithWrongOrder(p, g, h, CBigNum(256));
+    BOOST_CHECK(arithWrongOrder.powGH(e1, e2) == g.pow_mod(e1, p).mul_mod(h.pow_mod(e2, p), p));
+
+    // multi-exponentiation with any number of variable bases, including zero and negative exponents
+    std::vector<CBigNum> vBases, vExps;
+    CBigNum bnProduct = g.pow_mod(e2, p).mul_mod(h.pow_mod(e1 * -1, p), p);
+    BOOST_CHECK(arith.multiExp(vBases, vExps, e2, e1 * -1) == bnProduct);
+    for (int i = 0; i < 5; i++) {
+        vBases.push_back(CBigNum::randBignum(p - CBigNum(2)) + CBigNum(2));
+        vExps.push_back(i == 2 ? CBigNum(0) : CBigNum::RandKBitBigum(64 + 300 * i) * (i % 2 ? -1 : 1));
+        bnProduct = bnProduct.mul_mod(vBases.back().pow_mod(vExps.back(), p), p);
+        BOOST_CHECK(arith.multiExp(vBases, vExps, e2, e1 * -1) == bnProduct);
+    }
+    BOOST_CHECK(g.pow2_mod(e1, h, e2 * -1, p) == g.pow_mod(e1, p).mul_mod(h.pow_mod(e2 * -1, p), p));
+    vExps.pop_back();
+    BOOST_CHECK_THROW(arith.multiExp(vBases, vExps, e1, e2), std::runtime_error);
+
+    // repeated-base table, within its width, wider, negative and for an even modulus
+    RepeatedBaseTable tableRepeated(p, g, 1024);
+    for (uint32_t nExpBits : {1, 5, 6, 1023, 1024, 1025, 2048}) {
+        CBigNum e = CBigNum::RandKBitBigum(nExpBits);
+        BOOST_CHECK(tableRepeated.pow_mod(e) == g.pow_mod(e, p));
+    }
+    BOOST_CHECK(tableRepeated.pow_mod(CBigNum(0)) == CBigNum(1));
+    BOOST_CHECK(tableRepeated.pow_mod(e1 * -1) == g.pow_mod(e1 * -1, p));
+    BOOST_CHECK(RepeatedBaseTable(p * CBigNum(2), g, 1024).pow_mod(e1) == g.pow_mod(e1, p * CBigNum(2)));
+
+    // generators of a subgroup of prime order q: exponents are reduced mod q
+    CBigNum q = CBigNum::generatePrime(256, false);
+    CBigNum pq;
+    do {
+        pq = q * (CBigNum::RandKBitBigum(768) * CBigNum(2)) + CBigNum(1);
+    } while (!pq.isPrime());
+    CBigNum k = (pq - CBigNum(1)) / q;
+    CBigNum gq = CBigNum(2).pow_mod(k, pq);
+    CBigNum hq = CBigNum(3).pow_mod(k, pq);
+    GroupArithmetic arithOrder(pq, gq, hq, q);
+    CBigNum eWide = CBigNum::RandKBitBigum(2045);
+    BOOST_CHECK(arithOrder.powG(eWide) == gq.pow_mod(eWide, pq));
+    BOOST_CHECK(arithOrder.powH(eWide * -1) == hq.pow_mod(eWide * -1, pq));
+    BOOST_CHECK(arithOrder.powGH(eWide, e1 * -1) == gq.pow_mod(eWide, pq).mul_mod(hq.pow_mod(e1 * -1, pq), pq));
+    vBases.assign(1, CBigNum::randBignum(pq));
+    vExps.assign(1, eWide);
+    BOOST_CHECK(arithOrder.multiExp(vBases, vExps, eWide * -1, eWide) ==
+                vBases[0].pow_mod(eWide, pq).mul_mod(gq.pow_mod(eWide * -1, pq), pq).mul_mod(hq.pow_mod(eWide, pq), pq));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
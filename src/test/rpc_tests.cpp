@@ -6,6 +6,7 @@
 #include "rpcclient.h"
 
 #include "base58.h"
+#include "net.h"
 #include "netbase.h"
 #include "util.h"
 
@@ -263,4 +264,26 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_messagestats)
+{
+    BOOST_CHECK_EQUAL(MessageStatsBucket(0, false), 0U);
+    BOOST_CHECK_EQUAL(MessageStatsBucket(99, false), 0U);
+    BOOST_CHECK_EQUAL(MessageStatsBucket(100, false), 1U);
+    BOOST_CHECK_EQUAL(MessageStatsBucket(9999999, false), MESSAGE_STATS_BUCKETS - 1);
+    BOOST_CHECK_EQUAL(MessageStatsBucket(1, true), 1U);
+    BOOST_CHECK_EQUAL(MessageStatsBucket(3, true), 2U);
+    BOOST_CHECK_EQUAL(MessageStatsBucket(4, true), 3U);
+    BOOST_CHECK_EQUAL(MessageStatsBucket(1000, true), MESSAGE_STATS_BUCKETS - 1);
+
+    RecordMessageStats("ping", 50, 2000, 0);
+    RecordMessageStats("ping", 150, 200, 5);
+
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallRPC(string("getmessagestats")));
+    BOOST_CHECK_THROW(CallRPC(string("getmessagestats 1")), runtime_error);
+    UniValue ping = find_value(find_value(r.get_obj(), "messages").get_obj(), "ping");
+    BOOST_CHECK(find_value(ping.get_obj(), "count").get_int64() >= 2);
+    BOOST_CHECK_EQUAL(find_value(ping.get_obj(), "wait").size(), MESSAGE_STATS_BUCKETS);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 
 #include "main.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -35,6 +36,7 @@ struct TestingSetup {
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::UNITTEST);
         noui_connect();
+        InitSignatureCache();
 #ifdef ENABLE_WALLET
         bitdb.MakeMock();
 #endif
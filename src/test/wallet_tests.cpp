@@ -4,6 +4,10 @@
 
 #include "wallet.h"
 
+#include "accumulators.h"
+#include "random.h"
+#include "walletdb.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -12,6 +16,8 @@
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
+extern CWallet* pwalletMain;
+
 // how many times to run all the tests to have a chance to catch errors that only show up with particular random shuffles
 #define RUN_TESTS 100
 
@@ -308,4 +314,59 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(zerocoin_witness_cache)
+{
+    // A chain of 30 blocks
+    vector<uint256> vHashes(30);
+    vector<CBlockIndex> vBlocks(30);
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        vHashes[i] = GetRandHash();
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].nHeight = i;
+        vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+    }
+    CChain chain;
+    chain.SetTip(&vBlocks.back());
+
+    CAccumulatorWitnessCache witnessCache;
+    BOOST_CHECK(!witnessCache.AppliesTo(10, chain));
+    witnessCache.nHeightAccStart = 10;
+    witnessCache.nHeightAccumulated = 20;
+    witnessCache.hashBlockLast = vHashes[19];
+    witnessCache.bnWitness = CBigNum(12345);
+    witnessCache.nMintsAdded = 7;
+
+    // Write, then hit
+    CBigNum bnPubcoin = CBigNum(GetRandHash());
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    BOOST_CHECK(walletdb.WriteAccumulatorWitness(bnPubcoin, witnessCache));
+    CAccumulatorWitnessCache witnessCacheRead;
+    BOOST_CHECK(walletdb.ReadAccumulatorWitness(bnPubcoin, witnessCacheRead));
+    BOOST_CHECK_EQUAL(witnessCacheRead.nHeightAccumulated, 20);
+    BOOST_CHECK(witnessCacheRead.bnWitness == witnessCache.bnWitness);
+    BOOST_CHECK_EQUAL(witnessCacheRead.nMintsAdded, 7);
+    BOOST_CHECK(witnessCacheRead.AppliesTo(10, chain));
+
+    // Another starting checkpoint, or blocks that are not in the chain, invalidate it
+    BOOST_CHECK(!witnessCacheRead.AppliesTo(20, chain));
+    CChain chainShort;
+    chainShort.SetTip(&vBlocks[15]);
+    BOOST_CHECK(!witnessCacheRead.AppliesTo(10, chainShort));
+    uint256 hashReorg = GetRandHash();
+    vBlocks[19].phashBlock = &hashReorg;
+    BOOST_CHECK(!witnessCacheRead.AppliesTo(10, chain));
+    vBlocks[19].phashBlock = &vHashes[19];
+
+    // Spending the mint erases its witness
+    CZerocoinMint mint(libzerocoin::ZQ_ONE, bnPubcoin, CBigNum(1), CBigNum(2), true);
+    BOOST_CHECK(walletdb.WriteZerocoinMint(mint));
+    BOOST_CHECK(!walletdb.ReadAccumulatorWitness(bnPubcoin, witnessCacheRead));
+
+    // SyncTransaction erases it the same way when the mint is disconnected
+    BOOST_CHECK(walletdb.WriteAccumulatorWitness(bnPubcoin, witnessCache));
+    BOOST_CHECK(walletdb.EraseAccumulatorWitness(bnPubcoin));
+    BOOST_CHECK(!walletdb.ReadAccumulatorWitness(bnPubcoin, witnessCacheRead));
+    walletdb.EraseZerocoinMint(mint);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
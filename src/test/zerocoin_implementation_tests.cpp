@@ -5,9 +5,13 @@
 #include "libzerocoin/Denominations.h"
 #include "amount.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "main.h"
 #include "txdb.h"
+#include "zerocoinspendcache.h"
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <iostream>
 #include <accumulators.h>
 
@@ -410,4 +414,103 @@ BOOST_AUTO_TEST_CASE(checksum_tests)
 }
 
 
+BOOST_AUTO_TEST_CASE(accumulate_batch_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams* params = Params().Zerocoin_Params();
+
+    // more coins of one denomination than fit in a single exponent
+    std::vector<PublicCoin> vPubcoins;
+    for (unsigned int i = 0; i < ACCUMULATE_MAX_BATCH + 10; i++) {
+        CoinDenomination denom = i % 3 ? CoinDenomination::ZQ_ONE : zerocoinDenomList[i % zerocoinDenomList.size()];
+        vPubcoins.emplace_back(PublicCoin(params, CBigNum::randBignum(params->coinCommitmentGroup.modulus), denom));
+    }
+
+    AccumulatorMap mapSerial;
+    for (const PublicCoin& pubcoin : vPubcoins)
+        BOOST_CHECK(mapSerial.Accumulate(pubcoin, true));
+
+    AccumulatorMap mapBatch;
+    BOOST_CHECK(mapBatch.Accumulate(vPubcoins, true));
+
+    for (auto& denom : zerocoinDenomList)
+        BOOST_CHECK(mapSerial.GetValue(denom) == mapBatch.GetValue(denom));
+    BOOST_CHECK(mapSerial.GetCheckpoint() == mapBatch.GetCheckpoint());
+
+    // an empty list leaves the accumulators unchanged
+    uint256 nCheckpoint = mapBatch.GetCheckpoint();
+    BOOST_CHECK(mapBatch.Accumulate(std::vector<PublicCoin>(), true));
+    BOOST_CHECK(mapBatch.GetCheckpoint() == nCheckpoint);
+}
+
+/** Verify checks the way CheckBlock does, on a check queue served by worker threads */
+static bool RunZerocoinSpendChecks(CCheckQueue<CZerocoinSpendCheck>& queue, std::vector<CZerocoinSpendCheck>& vChecks)
+{
+    CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+BOOST_AUTO_TEST_CASE(zerocoinspendcheck_queue_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams* params = Params().Zerocoin_Params();
+
+    // spend a fresh coin from an accumulator that also holds another one
+    PrivateCoin coin(params, CoinDenomination::ZQ_ONE);
+    PrivateCoin coinOther(params, CoinDenomination::ZQ_ONE);
+    Accumulator accumulator(params, CoinDenomination::ZQ_ONE);
+    accumulator += coinOther.getPublicCoin();
+    AccumulatorWitness witness(params, accumulator, coin.getPublicCoin());
+    accumulator += coin.getPublicCoin();
+    uint32_t nChecksum = GetChecksum(accumulator.getValue());
+    CoinSpend spend(params, coin, accumulator, nChecksum, witness, 0);
+    uint256 hashSpend = CZerocoinSpendCache::GetSpendHash(spend);
+
+    // an accumulator value that does not contain the spent coin
+    Accumulator accumulatorBad(params, CoinDenomination::ZQ_ONE);
+    accumulatorBad += coinOther.getPublicCoin();
+
+    CCheckQueueHost host;
+    CCheckQueue<CZerocoinSpendCheck> queue(4, &host);
+    boost::thread_group workers;
+    for (int i = 0; i < 2; i++)
+        workers.create_thread(boost::bind(&CCheckQueueHost::Thread, &host));
+
+    // the serial path of CheckZerocoinSpend
+    Accumulator accumulatorGoodSerial(params, spend.getDenomination(), accumulator.getValue());
+    Accumulator accumulatorBadSerial(params, spend.getDenomination(), accumulatorBad.getValue());
+    BOOST_CHECK(spend.Verify(accumulatorGoodSerial));
+    BOOST_CHECK(!spend.Verify(accumulatorBadSerial));
+
+    // the queued path accepts the good spend and caches it
+    zerocoinSpendCache.Clear();
+    std::vector<CZerocoinSpendCheck> vChecks;
+    vChecks.push_back(CZerocoinSpendCheck(spend, accumulator.getValue(), uint256(1), hashSpend));
+    BOOST_CHECK(RunZerocoinSpendChecks(queue, vChecks));
+    BOOST_CHECK(zerocoinSpendCache.Get(hashSpend, nChecksum));
+
+    // and rejects the bad one without caching it
+    zerocoinSpendCache.Clear();
+    vChecks.clear();
+    vChecks.push_back(CZerocoinSpendCheck(spend, accumulatorBad.getValue(), uint256(1), hashSpend));
+    BOOST_CHECK(!RunZerocoinSpendChecks(queue, vChecks));
+    BOOST_CHECK(!zerocoinSpendCache.Get(hashSpend, nChecksum));
+
+    // one bad spend among good ones fails the whole block
+    vChecks.clear();
+    for (int i = 0; i < 6; i++)
+        vChecks.push_back(CZerocoinSpendCheck(spend, (i == 4 ? accumulatorBad : accumulator).getValue(), uint256(i + 1), hashSpend));
+    BOOST_CHECK(!RunZerocoinSpendChecks(queue, vChecks));
+
+    // the queue is reset for the next block
+    vChecks.clear();
+    vChecks.push_back(CZerocoinSpendCheck(spend, accumulator.getValue(), uint256(1), hashSpend));
+    BOOST_CHECK(RunZerocoinSpendChecks(queue, vChecks));
+
+    workers.interrupt_all();
+    workers.join_all();
+    zerocoinSpendCache.Clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
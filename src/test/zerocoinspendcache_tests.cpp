@@ -0,0 +1,47 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zerocoinspendcache.h"
+#include "random.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(zerocoinspendcache_tests)
+
+BOOST_AUTO_TEST_CASE(spendcache_hits_and_misses)
+{
+    CZerocoinSpendCache cache;
+    uint256 hashSpend = GetRandHash();
+
+    BOOST_CHECK(!cache.Get(hashSpend, 1));
+    cache.Set(hashSpend, 1);
+    BOOST_CHECK(cache.Get(hashSpend, 1));
+    // Same spend against a different accumulator checkpoint is not known valid
+    BOOST_CHECK(!cache.Get(hashSpend, 2));
+
+    uint64_t nHits, nMisses, nSize;
+    cache.GetStats(nHits, nMisses, nSize);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 2U);
+    BOOST_CHECK_EQUAL(nSize, 1U);
+
+    cache.Clear();
+    BOOST_CHECK(!cache.Get(hashSpend, 1));
+}
+
+BOOST_AUTO_TEST_CASE(spendcache_bounded)
+{
+    mapArgs["-maxspendcachesize"] = "10";
+    CZerocoinSpendCache cache;
+    for (int i = 0; i < 100; i++)
+        cache.Set(GetRandHash(), i);
+
+    uint64_t nHits, nMisses, nSize;
+    cache.GetStats(nHits, nMisses, nSize);
+    BOOST_CHECK_EQUAL(nSize, 10U);
+    mapArgs.erase("-maxspendcachesize");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "pow.h"
 #include "uint256.h"
 #include "accumulators.h"
+#include "ui_interface.h"
 
 #include <stdint.h>
 
@@ -18,12 +19,102 @@
 using namespace std;
 using namespace libzerocoin;
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
-{
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
+static const char DB_COINS = 'c';
+static const char DB_COIN_OUTPUT = 'C';
+static const char DB_COIN_TXID = 'T';
+static const char DB_COINS_LAYOUT = 'L';
+
+//! Value of the DB_COINS_LAYOUT record once the chainstate holds per-output records
+static const int COINS_LAYOUT_PER_OUTPUT = 1;
+
+namespace {
+/**
+ * Chainstate record for a single unspent output, keyed by its COutPoint.
+ * Each record repeats the metadata of the transaction that created it, so
+ * spending an output only deletes its own record.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nHeight * 4 + fCoinStake * 2 + fCoinBase)
+ * - the output (via CTxOutCompressor)
+ *
+ * A 'T' record keyed by txid marks each transaction with unspent outputs, so
+ * that lookups of absent transactions are point reads that the bloom filter
+ * answers, and only present ones seek over the 'C' records.
+ */
+class CCoinsOutputRecord
+{
+public:
+    CCoins& coins;
+    unsigned int nPos;
+
+    CCoinsOutputRecord(CCoins& coinsIn, unsigned int nPosIn) : coins(coinsIn), nPos(nPosIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        unsigned int nCode = coins.nHeight * 4 + (coins.fCoinStake ? 2 : 0) + (coins.fCoinBase ? 1 : 0);
+        READWRITE(VARINT(coins.nVersion));
+        READWRITE(VARINT(nCode));
+        if (ser_action.ForRead()) {
+            coins.nHeight = nCode / 4;
+            coins.fCoinStake = (nCode & 2) != 0;
+            coins.fCoinBase = (nCode & 1) != 0;
+            if (coins.vout.size() <= nPos)
+                coins.vout.resize(nPos + 1);
+        }
+        READWRITE(REF(CTxOutCompressor(coins.vout[nPos])));
+    }
+};
+
+/** Add the outputs stored under the cursor's current transaction to coins, leaving the cursor on the next one */
+bool ReadCoinsOutputs(leveldb::Iterator* pcursor, const uint256& txid, CCoins& coins, size_t* pnSize = NULL)
+{
+    bool fFound = false;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        char chType;
+        COutPoint outpoint;
+        ssKey >> chType;
+        if (chType != DB_COIN_OUTPUT)
+            break;
+        ssKey >> outpoint;
+        if (outpoint.hash != txid)
+            break;
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        CCoinsOutputRecord record(coins, outpoint.n);
+        ssValue >> record;
+        if (pnSize)
+            *pnSize += 32 + slValue.size();
+        fFound = true;
+    }
+    return fFound;
+}
+
+void BatchWriteCoinsOutputs(CLevelDBBatch& batch, const uint256& hash, const CCoinsCacheEntry& entry)
+{
+    // Entries the database did not have yet are written in full, for other
+    // ones only the outputs that were created or spent are touched.
+    CCoins& coins = const_cast<CCoins&>(entry.coins);
+    bool fFresh = (entry.flags & CCoinsCacheEntry::FRESH) != 0;
+    size_t nOutputs = fFresh ? coins.vout.size() : entry.vModified.size();
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        if (!fFresh && !entry.vModified[i])
+            continue;
+        if (i < coins.vout.size() && !coins.vout[i].IsNull())
+            batch.Write(make_pair(DB_COIN_OUTPUT, COutPoint(hash, i)), CCoinsOutputRecord(coins, i));
+        else if (!fFresh)
+            batch.Erase(make_pair(DB_COIN_OUTPUT, COutPoint(hash, i)));
+    }
+    if (!coins.IsPruned())
+        batch.Write(make_pair(DB_COIN_TXID, hash), '1');
+    else if (!fFresh)
+        batch.Erase(make_pair(DB_COIN_TXID, hash));
+}
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
@@ -37,12 +128,25 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(make_pair('c', txid), coins);
+    if (!db.Exists(make_pair(DB_COIN_TXID, txid)))
+        return false;
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator(true));
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_COIN_OUTPUT, COutPoint(txid, 0));
+    pcursor->Seek(leveldb::Slice(&ssKeySet[0], ssKeySet.size()));
+
+    coins.Clear();
+    try {
+        return ReadCoinsOutputs(pcursor.get(), txid, coins);
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(make_pair('c', txid));
+    return db.Exists(make_pair(DB_COIN_TXID, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
@@ -54,26 +158,205 @@ uint256 CCoinsViewDB::GetBestBlock() const
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    bool fOk = WriteCoins(mapCoins, hashBlock);
+    mapCoins.clear();
+    return fOk;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock, size_t* pnBytes)
 {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            BatchWriteCoinsOutputs(batch, it->first, it->second);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    if (pnBytes)
+        *pnBytes = batch.SizeEstimate();
     return db.WriteBatch(batch);
 }
 
+CCoinsViewAsyncFlush::CCoinsViewAsyncFlush(CCoinsViewDB* dbIn, unsigned int nMaxPendingIn) : CCoinsViewBacked(dbIn), db(dbIn), nMaxPending(nMaxPendingIn), nPendingUsage(0), fStop(false), fFailed(false)
+{
+    if (nMaxPending > 0)
+        threadFlush = boost::thread(boost::bind(&CCoinsViewAsyncFlush::ThreadFlush, this));
+}
+
+CCoinsViewAsyncFlush::~CCoinsViewAsyncFlush()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condFlush.notify_all();
+    if (threadFlush.joinable())
+        threadFlush.join();
+    // Only left over if a write failed
+    for (std::deque<Snapshot*>::iterator it = queuePending.begin(); it != queuePending.end(); it++)
+        delete *it;
+}
+
+bool CCoinsViewAsyncFlush::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        // The newest pending snapshot has the most recent version of an entry
+        for (std::deque<Snapshot*>::const_reverse_iterator it = queuePending.rbegin(); it != queuePending.rend(); it++) {
+            CCoinsMap::const_iterator itCoins = (*it)->mapCoins.find(txid);
+            if (itCoins != (*it)->mapCoins.end()) {
+                coins = itCoins->second.coins;
+                return true;
+            }
+        }
+    }
+    return db->GetCoins(txid, coins);
+}
+
+bool CCoinsViewAsyncFlush::HaveCoins(const uint256& txid) const
+{
+    CCoins coins;
+    return GetCoins(txid, coins);
+}
+
+uint256 CCoinsViewAsyncFlush::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (std::deque<Snapshot*>::const_reverse_iterator it = queuePending.rbegin(); it != queuePending.rend(); it++) {
+            if ((*it)->hashBlock != uint256(0))
+                return (*it)->hashBlock;
+        }
+    }
+    return db->GetBestBlock();
+}
+
+bool CCoinsViewAsyncFlush::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    if (nMaxPending == 0) {
+        int64_t nStart = GetTimeMicros();
+        size_t nBytes = 0;
+        bool fOk = db->WriteCoins(mapCoins, hashBlock, &nBytes);
+        mapCoins.clear();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        RecordFlush(GetTimeMicros() - nStart, nBytes);
+        return fOk;
+    }
+
+    // Take over the dirty set, the caller continues with an empty cache.
+    Snapshot* snapshot = new Snapshot();
+    snapshot->mapCoins.swap(mapCoins);
+    snapshot->hashBlock = hashBlock;
+    snapshot->nUsage = snapshot->mapCoins.DynamicMemoryUsage();
+    for (CCoinsMap::const_iterator it = snapshot->mapCoins.begin(); it != snapshot->mapCoins.end(); it++)
+        snapshot->nUsage += it->second.DynamicMemoryUsage();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (queuePending.size() >= nMaxPending) {
+        flushStats.nStalls++;
+        while (queuePending.size() >= nMaxPending && !fFailed)
+            condDone.wait(lock);
+    }
+    if (fFailed) {
+        delete snapshot;
+        return false;
+    }
+    queuePending.push_back(snapshot);
+    nPendingUsage += snapshot->nUsage;
+    condFlush.notify_one();
+    return true;
+}
+
+bool CCoinsViewAsyncFlush::GetStats(CCoinsStats& stats) const
+{
+    if (!const_cast<CCoinsViewAsyncFlush*>(this)->Sync())
+        return false;
+    return db->GetStats(stats);
+}
+
+bool CCoinsViewAsyncFlush::Sync()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!queuePending.empty() && !fFailed)
+        condDone.wait(lock);
+    return !fFailed;
+}
+
+void CCoinsViewAsyncFlush::GetFlushStats(CCoinsFlushStats& statsOut) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    statsOut = flushStats;
+    statsOut.nPending = queuePending.size();
+    statsOut.nPendingUsage = nPendingUsage;
+}
+
+size_t CCoinsViewAsyncFlush::PendingMemoryUsage() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nPendingUsage;
+}
+
+void CCoinsViewAsyncFlush::RecordFlush(int64_t nDuration, size_t nBytes)
+{
+    flushStats.nFlushes++;
+    flushStats.nLastDuration = nDuration;
+    flushStats.nTotalDuration += nDuration;
+    flushStats.nLastBytes = nBytes;
+    flushStats.nTotalBytes += nBytes;
+    LogPrint("coindb", "Flushed %u bytes to coin database in %.2fms\n", (unsigned int)nBytes, 0.001 * nDuration);
+}
+
+void CCoinsViewAsyncFlush::ThreadFlush()
+{
+    RenameThread("opcx-coinsflush");
+    while (true) {
+        Snapshot* snapshot;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queuePending.empty() && !fStop)
+                condFlush.wait(lock);
+            if (queuePending.empty() || fFailed)
+                return;
+            snapshot = queuePending.front();
+        }
+
+        // The snapshot stays in the queue, readable by GetCoins, until the
+        // database has committed it. Nothing modifies it in the meantime.
+        int64_t nStart = GetTimeMicros();
+        size_t nBytes = 0;
+        bool fOk = false;
+        try {
+            fOk = db->WriteCoins(snapshot->mapCoins, snapshot->hashBlock, &nBytes);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : %s\n", __func__, e.what());
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (!fOk) {
+                // Keep the snapshot visible; every later flush now fails.
+                LogPrintf("%s : failed to write to coin database\n", __func__);
+                fFailed = true;
+                condDone.notify_all();
+                return;
+            }
+            queuePending.pop_front();
+            nPendingUsage -= snapshot->nUsage;
+            RecordFlush(GetTimeMicros() - nStart, nBytes);
+        }
+        condDone.notify_all();
+        delete snapshot;
+    }
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
 {
 }
@@ -117,6 +400,77 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
+bool CCoinsViewDB::Upgrade(std::string& strError)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_COINS, uint256(0));
+    pcursor->Seek(leveldb::Slice(&ssKeySet[0], ssKeySet.size()));
+    bool fLegacyRecords = pcursor->Valid() && pcursor->key()[0] == DB_COINS;
+
+    if (db.Exists(DB_COINS_LAYOUT)) {
+        // Only an older version writes per-transaction records after the upgrade,
+        // and the outputs it spent or created are missing from the per-output ones
+        if (fLegacyRecords) {
+            strError = _("The chainstate database was upgraded to per-output records, which older versions cannot read, and was then modified by an older version. Rebuild it with -reindex.");
+            return error("%s : per-transaction records found in an upgraded chainstate database", __func__);
+        }
+        return true;
+    }
+    if (!fLegacyRecords)
+        return db.Write(DB_COINS_LAYOUT, COINS_LAYOUT_PER_OUTPUT, true);
+
+    LogPrintf("Upgrading chainstate database to per-output records. This cannot be undone, older versions will not be able to read the chainstate database afterwards.\n");
+    uiInterface.ShowProgress(_("Upgrading chainstate database..."), 0);
+    CLevelDBBatch batch;
+    size_t nBatchTransactions = 0;
+    uint64_t nTransactions = 0;
+    int nReportDone = 0;
+    while (pcursor->Valid()) {
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey[0] != DB_COINS)
+            break;
+        try {
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txid;
+            ssKey >> chType >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoinsCacheEntry entry;
+            ssValue >> entry.coins;
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            BatchWriteCoinsOutputs(batch, txid, entry);
+            batch.Erase(make_pair(DB_COINS, txid));
+
+            // Keys are ordered by txid, whose first serialized byte is uniformly distributed
+            int nReport = (unsigned char)slKey[1] * 100 / 256;
+            if (nReport > nReportDone) {
+                nReportDone = nReport;
+                uiInterface.ShowProgress(_("Upgrading chainstate database..."), nReportDone);
+            }
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        nTransactions++;
+        // Commit in batches, an interrupted upgrade resumes from the remaining records
+        if (++nBatchTransactions >= COINS_UPGRADE_BATCH_SIZE) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch = CLevelDBBatch();
+            nBatchTransactions = 0;
+        }
+        pcursor->Next();
+    }
+    // Written last, an interrupted upgrade is not yet mistaken for a downgrade
+    batch.Write(DB_COINS_LAYOUT, COINS_LAYOUT_PER_OUTPUT);
+    if (!db.WriteBatch(batch, true))
+        return false;
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Upgraded %u transactions to per-output chainstate records\n", nTransactions);
+    return true;
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
@@ -136,13 +490,12 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            if (chType == DB_COIN_OUTPUT) {
+                COutPoint outpoint;
+                ssKey >> outpoint;
+                const uint256 txhash = outpoint.hash;
                 CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
+                ReadCoinsOutputs(pcursor.get(), txhash, coins, &stats.nSerializedSize);
                 ss << txhash;
                 ss << VARINT(coins.nVersion);
                 ss << (coins.fCoinBase ? 'c' : 'n');
@@ -157,10 +510,10 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                         nTotalAmount += out.nValue;
                     }
                 }
-                stats.nSerializedSize += 32 + slValue.size();
                 ss << VARINT(0);
+            } else {
+                pcursor->Next();
             }
-            pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
@@ -208,7 +561,7 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+bool CBlockTreeDB::LoadBlockIndexGuts(bool fVerifyHashes)
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
@@ -218,21 +571,63 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     // Load mapBlockIndex
     uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vHashes;
+    std::vector<uint256> vVerifiedHashes;
+    bool fDone = false;
+    while (!fDone) {
+        // Read the entries in batches so their header hashes can be verified together
+        vDiskIndex.clear();
+        vHeaders.clear();
+        vHashes.clear();
+        while (vDiskIndex.size() < BLOCK_INDEX_LOAD_BATCH_SIZE) {
+            boost::this_thread::interruption_point();
+            if (!pcursor->Valid()) {
+                fDone = true;
+                break;
+            }
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'b') {
+                    fDone = true;
+                    break; // if shutdown requested or finished loading block index
+                }
+                // The entry is keyed by its block hash, which was computed when the block was first
+                // indexed; reuse it instead of running the header hash chain again
+                uint256 hashBlock;
+                ssKey >> hashBlock;
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
                 CDiskBlockIndex diskindex;
                 ssValue >> diskindex;
+                vDiskIndex.push_back(diskindex);
+                vHashes.push_back(hashBlock);
+                if (fVerifyHashes)
+                    vHeaders.push_back(diskindex.GetBlockHeader());
+                pcursor->Next();
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+
+        if (fVerifyHashes) {
+            GetBlockHeaderHashes(vHeaders, vVerifiedHashes);
+            for (unsigned int i = 0; i < vHashes.size(); i++) {
+                if (vHashes[i] != vVerifiedHashes[i])
+                    return error("%s : block index entry %s hashes to %s, the block index is corrupted", __func__,
+                                 vHashes[i].GetHex(), vVerifiedHashes[i].GetHex());
+            }
+        }
 
+        for (unsigned int i = 0; i < vDiskIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+            try {
                 // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = InsertBlockIndex(vHashes[i]);
                 pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
                 pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
                 pindexNew->nHeight = diskindex.nHeight;
@@ -277,13 +672,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
                     nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
                 }
-
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
 
@@ -365,3 +756,18 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(make_pair('a', nChecksum));
 }
+
+bool CZerocoinDB::WriteBlockMints(const uint256& hashBlock, const std::vector<CZerocoinBlockMintTx>& vMintTxs)
+{
+    return Write(make_pair('b', hashBlock), vMintTxs);
+}
+
+bool CZerocoinDB::ReadBlockMints(const uint256& hashBlock, std::vector<CZerocoinBlockMintTx>& vMintTxs)
+{
+    return Read(make_pair('b', hashBlock), vMintTxs);
+}
+
+bool CZerocoinDB::EraseBlockMints(const uint256& hashBlock)
+{
+    return Erase(make_pair('b', hashBlock));
+}
@@ -11,11 +11,16 @@
 #include "main.h"
 #include "primitives/zerocoin.h"
 
+#include <deque>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 class CCoins;
 class uint256;
 
@@ -25,6 +30,14 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! number of block index entries read before their header hashes are verified in one batch
+static const size_t BLOCK_INDEX_LOAD_BATCH_SIZE = 16384;
+//! -checkblockhashes default, recompute every header hash of the block index at startup
+static const bool DEFAULT_CHECKBLOCKHASHES = false;
+//! number of transactions converted per write while upgrading the chainstate to per-output records
+static const size_t COINS_UPGRADE_BATCH_SIZE = 100000;
+//! -coinsflushqueue default, coins cache flushes that may be pending in the background
+static const unsigned int DEFAULT_COINS_FLUSH_QUEUE = 1;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -40,6 +53,84 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    //! Write the dirty entries of mapCoins without modifying it, optionally reporting the size of the write
+    virtual bool WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock, size_t* pnBytes = NULL);
+
+    /**
+     * Convert per-transaction records of older versions to per-output records.
+     * The conversion is irreversible: older versions cannot read the result.
+     * Fails with strError set if an older version wrote to the database since.
+     */
+    bool Upgrade(std::string& strError);
+};
+
+struct CCoinsFlushStats {
+    uint64_t nFlushes;
+    uint64_t nStalls;        //!< flushes that had to wait for a free slot in the queue
+    int64_t nLastDuration;   //!< in microseconds
+    int64_t nTotalDuration;  //!< in microseconds
+    uint64_t nLastBytes;
+    uint64_t nTotalBytes;
+    unsigned int nPending;
+    size_t nPendingUsage;    //!< memory held by the pending snapshots
+
+    CCoinsFlushStats() : nFlushes(0), nStalls(0), nLastDuration(0), nTotalDuration(0), nLastBytes(0), nTotalBytes(0), nPending(0), nPendingUsage(0) {}
+};
+
+/**
+ * CCoinsView that writes flushed caches to the coin database on a background
+ * thread. BatchWrite takes over the dirty set as a snapshot and returns, so
+ * the flushing cache continues with an empty map while the snapshot is
+ * written. Pending snapshots are searched, newest first, before the
+ * database, so reads always see the latest state. At most nMaxPending
+ * snapshots are queued; further flushes wait. With nMaxPending 0 writes are
+ * synchronous. The snapshots still hold their coins in memory until written,
+ * so their usage counts against the coins cache budget (see PendingMemoryUsage).
+ */
+class CCoinsViewAsyncFlush : public CCoinsViewBacked
+{
+private:
+    struct Snapshot {
+        CCoinsMap mapCoins;
+        uint256 hashBlock;
+        size_t nUsage;
+    };
+
+    CCoinsViewDB* db;
+    const unsigned int nMaxPending;
+
+    mutable boost::mutex mutex;
+    boost::condition_variable condFlush; //!< signals the flush thread that a snapshot is queued
+    boost::condition_variable condDone;  //!< signals waiters that a snapshot was written
+    std::deque<Snapshot*> queuePending;
+    size_t nPendingUsage; //!< sum of nUsage over queuePending
+    bool fStop;
+    bool fFailed;
+    CCoinsFlushStats flushStats;
+
+    boost::thread threadFlush;
+
+    void RecordFlush(int64_t nDuration, size_t nBytes);
+    void ThreadFlush();
+
+public:
+    CCoinsViewAsyncFlush(CCoinsViewDB* dbIn, unsigned int nMaxPendingIn);
+    ~CCoinsViewAsyncFlush();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool GetStats(CCoinsStats& stats) const;
+
+    //! Wait until every pending snapshot is written, returns false if a write failed
+    bool Sync();
+
+    //! Memory held by the snapshots not written yet, in the same measure as CCoinsViewCache::DynamicMemoryUsage
+    size_t PendingMemoryUsage() const;
+
+    void GetFlushStats(CCoinsFlushStats& statsOut) const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -66,7 +157,7 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
-    bool LoadBlockIndexGuts();
+    bool LoadBlockIndexGuts(bool fVerifyHashes = false);
 };
 
 class CZerocoinDB : public CLevelDBWrapper
@@ -88,6 +179,9 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    bool WriteBlockMints(const uint256& hashBlock, const std::vector<CZerocoinBlockMintTx>& vMintTxs);
+    bool ReadBlockMints(const uint256& hashBlock, std::vector<CZerocoinBlockMintTx>& vMintTxs);
+    bool EraseBlockMints(const uint256& hashBlock);
 };
 
 #endif // BITCOIN_TXDB_H
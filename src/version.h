@@ -10,7 +10,7 @@
 /**
  * network protocol versioning
  */
-static const int PROTOCOL_VERSION = 70911;
+static const int PROTOCOL_VERSION = 70912;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -32,4 +32,7 @@ static const int BIP0031_VERSION = 60000;
 //! "sendheaders" command and announcing blocks with headers starts with this version
 static const int SENDHEADERS_VERSION = 70911;
 
+//! "sendcmpct", "cmpctblock", "getblocktxn" and "blocktxn", compact block relay, start with this version
+static const int COMPACT_BLOCKS_VERSION = 70912;
+
 #endif // BITCOIN_VERSION_H
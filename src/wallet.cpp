@@ -655,6 +655,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        MarkStakeableDirty(wtx);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -699,6 +700,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        MarkStakeableDirty(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -749,6 +751,19 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
         if (!tx.IsZerocoinSpend() && mapWallet.count(txin.prevout.hash))
             mapWallet[txin.prevout.hash].MarkDirty();
     }
+
+    // A mint that is not in a block (anymore) has no witness, drop the cached ones
+    if (!pblock && tx.IsZerocoinMint() && fFileBacked) {
+        CWalletDB walletdb(strWalletFile);
+        BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+            if (!txout.IsZerocoinMint())
+                continue;
+            CValidationState state;
+            libzerocoin::PublicCoin pubCoin(Params().Zerocoin_Params());
+            if (TxOutToPublicCoin(txout, pubCoin, state))
+                walletdb.EraseAccumulatorWitness(pubCoin.getValue());
+        }
+    }
 }
 
 void CWallet::EraseFromWallet(const uint256& hash)
@@ -757,8 +772,12 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
+        std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end())
+            MarkStakeableDirty(it->second);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        setStakeableDirty.insert(hash);
     }
     return;
 }
@@ -1999,6 +2018,21 @@ CAmount CWallet::GetLockedWatchOnlyBalance() const
 /**
  * populate vCoins with vector of available COutputs.
  */
+/**
+ * Whether AvailableCoins lists an output of this ownership. nWatchonlyConfig 1
+ * leaves out watch-only outputs, 2 lists only those and 3 lists both.
+ */
+static bool IsIncludedByWatchonlyConfig(isminetype mine, int nWatchonlyConfig)
+{
+    if (mine == ISMINE_NO)
+        return false;
+    if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2)
+        return false;
+    if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
+        return false;
+    return true;
+}
+
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig) const
 {
     vCoins.clear();
@@ -2058,13 +2092,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 isminetype mine = IsMine(pcoin->vout[i]);
                 if (IsSpent(wtxid, i))
                     continue;
-                if (mine == ISMINE_NO)
-                    continue;
-
-                if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2)
-                    continue;
-
-                if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
+                if (!IsIncludedByWatchonlyConfig(mine, nWatchonlyConfig))
                     continue;
 
                 if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
@@ -2164,43 +2192,113 @@ bool less_then_denom(const COutput& out1, const COutput& out2)
     return (!found1 && found2);
 }
 
-bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount, int nTargetHeight) const
+void CWallet::MarkStakeableDirty(const CWalletTx& wtx)
 {
-    // comment by DR:
-    // SelectStakeCoins => IsInMainChain => GetDepthInMainChainINTERNAL => AssertLockHeld(cs_main)
-    // IsInMainChain was added in PIVX and is called from 3 other places (this is one)
-    // that (atm) do not lock cs_main (thus allowing other threads to jump in and failing w/ that assert)
-    // we need to follow the refs to IsInMainChain and do the rest
-    LOCK(cs_main);
+    setStakeableDirty.insert(wtx.GetHash());
+    // The outputs it spends are no longer stakeable
+    if (wtx.IsCoinBase() || wtx.IsZerocoinSpend())
+        return;
+    BOOST_FOREACH (const CTxIn& txin, wtx.vin) {
+        if (mapWallet.count(txin.prevout.hash))
+            setStakeableDirty.insert(txin.prevout.hash);
+    }
+}
+
+void CWallet::UpdateStakeableOutputs()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // A spender that left the mempool without being mined, e.g. conflicted or
+    // evicted, no longer spends its inputs, so they may stake again
+    for (std::set<uint256>::iterator it = setStakeableSpenders.begin(); it != setStakeableSpenders.end();) {
+        std::map<uint256, CWalletTx>::const_iterator wit = mapWallet.find(*it);
+        if (wit != mapWallet.end() && wit->second.GetDepthInMainChain(false) == 0) {
+            ++it;
+            continue;
+        }
+        if (wit != mapWallet.end())
+            MarkStakeableDirty(wit->second);
+        setStakeableSpenders.erase(it++);
+    }
+
+    BOOST_FOREACH (const uint256& hash, setStakeableDirty) {
+        std::map<uint256, int>::iterator mi = mapStakeableTxHeight.find(hash);
+        if (mi != mapStakeableTxHeight.end()) {
+            std::set<std::pair<int, COutPoint> >::iterator it = setStakeableOutputs.lower_bound(make_pair(mi->second, COutPoint(hash, 0)));
+            while (it != setStakeableOutputs.end() && it->first == mi->second && it->second.hash == hash)
+                setStakeableOutputs.erase(it++);
+            mapStakeableTxHeight.erase(mi);
+        }
+
+        std::map<uint256, CWalletTx>::const_iterator wit = mapWallet.find(hash);
+        if (wit == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = wit->second;
+        const CBlockIndex* pindex = NULL;
+        int nDepth = wtx.GetDepthInMainChain(pindex, false);
+        if (nDepth == 0 && !wtx.IsCoinBase() && !wtx.IsZerocoinSpend()) {
+            BOOST_FOREACH (const CTxIn& txin, wtx.vin) {
+                if (mapWallet.count(txin.prevout.hash)) {
+                    setStakeableSpenders.insert(hash);
+                    break;
+                }
+            }
+        }
+        if (nDepth <= 0)
+            continue;
+
+        // Coinbases and coinstakes must be mature, other transactions 10 blocks deep
+        int nDepthRequired = (wtx.IsCoinBase() || wtx.IsCoinStake()) ? Params().COINBASE_MATURITY() + 1 : 10;
+        int nHeightStakeable = pindex->nHeight + nDepthRequired - 1;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            const CTxOut& txout = wtx.vout[i];
+            if (txout.nValue <= 0 || txout.IsZerocoinMint() || IsSpent(hash, i))
+                continue;
+            // The outputs AvailableCoins lists with the default nWatchonlyConfig, which staking used
+            if (!IsIncludedByWatchonlyConfig(IsMine(txout), 1))
+                continue;
+            setStakeableOutputs.insert(make_pair(nHeightStakeable, COutPoint(hash, i)));
+            mapStakeableTxHeight[hash] = nHeightStakeable;
+        }
+    }
+    setStakeableDirty.clear();
+}
+
+bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount, int nTargetHeight)
+{
+    // DLOCKSFIX: order of locks: cs_main, mempool.cs, cs_wallet, the depth checks take mempool.cs
+    LOCK3(cs_main, mempool.cs, cs_wallet);
+    UpdateStakeableOutputs();
 
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
     CAmount nAmountSelected = 0;
+    std::set<std::pair<int, COutPoint> >::const_iterator it;
+    for (it = setStakeableOutputs.begin(); it != setStakeableOutputs.end() && it->first <= chainActive.Height(); ++it) {
+        const COutPoint& outpoint = it->second;
+        const CWalletTx& wtx = mapWallet[outpoint.hash];
+        if (IsLockedCoin(outpoint.hash, outpoint.n))
+            continue;
+
+        // Same filters as AvailableCoins applies to stakeable coins
+        if (!CheckFinalTx(wtx) || !wtx.IsTrusted())
+            continue;
 
-    for (const COutput& out : vCoins) {
         //make sure not to outrun target amount
-        if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount)
+        if (nAmountSelected + wtx.vout[outpoint.n].nValue > nTargetAmount)
             continue;
 
         //if zerocoinspend, then use the block time
-        int64_t nTxTime = out.tx->GetTxTime();
-        if (out.tx->IsZerocoinSpend()) {
-            if (!out.tx->IsInMainChain())
-                continue;
-            nTxTime = mapBlockIndex.at(out.tx->hashBlock)->GetBlockTime();
-        }
+        int64_t nTxTime = wtx.GetTxTime();
+        if (wtx.IsZerocoinSpend())
+            nTxTime = mapBlockIndex.at(wtx.hashBlock)->GetBlockTime();
 
         //check for min age
         if (GetAdjustedTime() - nTxTime < Params().GetMinStakeAge(nTargetHeight))
             continue;
 
-        //check that it is matured
-        if (out.nDepth < (out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10))
-            continue;
-
         //add to our stake set
-        setCoins.insert(make_pair(out.tx, out.i));
-        nAmountSelected += out.tx->vout[out.i].nValue;
+        setCoins.insert(make_pair(&wtx, outpoint.n));
+        nAmountSelected += wtx.vout[outpoint.n].nValue;
     }
 
     return true;
@@ -3035,17 +3133,10 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (nBalance <= nReserveBalance)
         return false;
 
-    // presstab HyperStake - Initialize as static and don't update the set on every run of CreateCoinStake() in order to lighten resource use
-    static std::set<pair<const CWalletTx*, unsigned int> > setStakeCoins;
-    static int nLastStakeSetUpdate = 0;
-
-    if (GetTime() - nLastStakeSetUpdate > nStakeSetUpdateTime) {
-        setStakeCoins.clear();
-        if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance, chainActive.Height() + 1))
-            return false;
-
-        nLastStakeSetUpdate = GetTime();
-    }
+    // The stakeable outputs are kept up to date by the wallet, so selecting is cheap enough for every round
+    std::set<pair<const CWalletTx*, unsigned int> > setStakeCoins;
+    if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance, chainActive.Height() + 1))
+        return false;
 
     if (setStakeCoins.empty())
         return false;
@@ -3059,92 +3150,66 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
         MilliSleep(10000);
 
-    BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
-            continue;
+    //search the kernels of all coins at once, for timestamps that will pass the median time check
+    vector<pair<const CWalletTx*, unsigned int> > vStakeCoins(setStakeCoins.begin(), setStakeCoins.end());
+    vector<CStakeCandidate> vCandidates;
+    vCandidates.reserve(vStakeCoins.size());
+    BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, vStakeCoins)
+        vCandidates.push_back(CStakeCandidate(COutPoint(pcoin.first->GetHash(), pcoin.second), pcoin.first->vout[pcoin.second].nValue, pcoin.first->hashBlock));
+
+    uint256 hashProofOfStake = 0;
+    int nKernel = FindStakeKernel(nBits, vCandidates, GetAdjustedTime(), nHashDrift, chainActive.Tip()->GetMedianTimePast(), nTxNewTime, hashProofOfStake);
+    if (nKernel >= 0) {
+        const PAIRTYPE(const CWalletTx*, unsigned int)& pcoin = vStakeCoins[nKernel];
+
+        // Found a kernel
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : kernel found\n");
+
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+            LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            return false;
         }
-
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
-
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
-
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            return false; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            //convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
                 if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false; // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
-
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        } else
+            scriptPubKeyOut = scriptPubKeyKernel;
 
-            //presstab HyperStake - calculate the total size of our new output not including the stake reward to decide whether to split the stake outputs
-            uint64_t nSplitSize = pcoin.first->vout[pcoin.second].nValue;
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            // ZC999FIX: should this be a COIN?
-            if (nSplitSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - calculate the total size of our new output not including the stake reward to decide whether to split the stake outputs
+        uint64_t nSplitSize = pcoin.first->vout[pcoin.second].nValue;
 
-            //const CBlockIndex* pIndex0 = chainActive.Tip();
-            //uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight, 0, false);
-            //if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-            //    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+        // ZC999FIX: should this be a COIN?
+        if (nSplitSize / 2 > nStakeSplitThreshold * COIN)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
     }
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance) {
@@ -3175,7 +3240,6 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     }
 
     // Successfully generated coinstake
-    nLastStakeSetUpdate = 0; //this will trigger stake set to repopulate next round
     return true;
 }
 
@@ -4658,6 +4722,57 @@ bool CWallet::CreateZerocoinMintTransaction(const CAmount nValue, CMutableTransa
     return true;
 }
 
+void CWallet::UpdateZerocoinWitnesses()
+{
+    CWalletDB walletdb(strWalletFile);
+    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(true, true, false);
+    for (const CZerocoinMint& mint : listMints) {
+        boost::this_thread::interruption_point();
+
+        libzerocoin::PublicCoin pubCoin(Params().Zerocoin_Params(), mint.GetValue(), mint.GetDenomination());
+        libzerocoin::Accumulator accumulator(Params().Zerocoin_Params(), mint.GetDenomination());
+        libzerocoin::AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, pubCoin);
+        CAccumulatorWitnessCache witnessCache;
+        walletdb.ReadAccumulatorWitness(mint.GetValue(), witnessCache);
+        int nHeightCached = witnessCache.nHeightAccumulated;
+
+        // Security level 100 takes the witness as far as the chain allows
+        int nMintsAdded = 0;
+        string strError;
+        GenerateAccumulatorWitness(pubCoin, accumulator, witness, 100, nMintsAdded, strError, &witnessCache);
+        if (witnessCache.nHeightAccumulated != nHeightCached) {
+            // Not for a mint spent in the meantime, its witness was erased
+            CZerocoinMint mintNow;
+            if (!walletdb.ReadZerocoinMint(mint.GetValue(), mintNow) || mintNow.IsUsed())
+                continue;
+            LogPrint("zero", "%s : witness of %s advanced from block %d to %d\n", __func__, mint.GetValue().GetHex().substr(0, 16), nHeightCached, witnessCache.nHeightAccumulated);
+            walletdb.WriteAccumulatorWitness(mint.GetValue(), witnessCache);
+        }
+    }
+}
+
+void ThreadZerocoinWitnesses()
+{
+    RenameThread("opcx-zcwitness");
+
+    // Witnesses only grow when a new checkpoint is two checkpoints deep, so look once per checkpoint
+    int nCheckpointLast = -1;
+    while (true) {
+        MilliSleep(5000);
+
+        int nCheckpoint;
+        {
+            LOCK(cs_main);
+            nCheckpoint = chainActive.Height() / 10;
+        }
+        if (nCheckpoint == nCheckpointLast || IsInitialBlockDownload() || !pwalletMain)
+            continue;
+
+        pwalletMain->UpdateZerocoinWitnesses();
+        nCheckpointLast = nCheckpoint;
+    }
+}
+
 bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, const uint256& hashTxOut, CTxIn& newTxIn, CZerocoinSpendReceipt& receipt)
 {
     // Default error status if not changed below
@@ -4677,7 +4792,14 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
     libzerocoin::AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, pubCoinSelected);
     string strFailReason = "";
     int nMintsAdded = 0;
-    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason)) {
+    CWalletDB walletdb(strWalletFile);
+    CAccumulatorWitnessCache witnessCache;
+    walletdb.ReadAccumulatorWitness(pubCoinSelected.getValue(), witnessCache);
+    int nHeightCached = witnessCache.nHeightAccumulated;
+    bool fWitness = GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, &witnessCache);
+    if (witnessCache.nHeightAccumulated != nHeightCached)
+        walletdb.WriteAccumulatorWitness(pubCoinSelected.getValue(), witnessCache);
+    if (!fWitness) {
         receipt.SetStatus(_("Try to spend with a higher security level to include more coins"), ZPIV_FAILED_ACCUMULATOR_INITIALIZATION);
         LogPrintf("%s : %s \n", __func__, receipt.GetStatusMessage());
         return false;
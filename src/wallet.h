@@ -62,6 +62,9 @@ static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 // ZCDENOMINATIONS: hardcoded value (on each change)
 static const int ZQ_6666 = 166650; // 666600; // 6666;
 
+/** Keep the accumulator witnesses of pwalletMain's unspent mints up to date as checkpoints arrive */
+void ThreadZerocoinWitnesses();
+
 class CAccountingEntry;
 class CCoinControl;
 class COutput;
@@ -189,9 +192,21 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs that may stake, ordered by the chain height at which they are
+     * deep enough. Transactions AddToWallet sees are refiled before the next
+     * selection, so staking never has to scan all of mapWallet.
+     */
+    std::set<std::pair<int, COutPoint> > setStakeableOutputs;
+    std::map<uint256, int> mapStakeableTxHeight; //!< height the outputs of a transaction are filed under
+    std::set<uint256> setStakeableDirty;         //!< transactions to refile
+    std::set<uint256> setStakeableSpenders;      //!< unconfirmed transactions spending wallet outputs, their inputs are refiled once they leave the mempool
+    void MarkStakeableDirty(const CWalletTx& wtx);
+    void UpdateStakeableOutputs();
+
 public:
     bool MintableCoins(int nTargetHeight) const;
-    bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount, int nTargetHeight) const;
+    bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount, int nTargetHeight);
     bool SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const;
     bool SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax);
     bool SelectCoinsDarkDenominated(CAmount nTargetValue, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet) const;
@@ -212,6 +227,8 @@ public:
     std::string ResetSpentZerocoin();
     void ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored);
     void ZPivBackupWallet();
+    //! Advance the cached accumulator witnesses of the unspent, mature mints
+    void UpdateZerocoinWitnesses();
 
     /** Zerocin entry changed.
     * @note called with lock cs_wallet held.
@@ -243,7 +260,6 @@ public:
     unsigned int nHashDrift;
     unsigned int nHashInterval;
     uint64_t nStakeSplitThreshold;
-    int nStakeSetUpdateTime;
 
     //MultiSend
     std::vector<std::pair<std::string, int> > vMultiSend;
@@ -294,7 +310,6 @@ public:
         nHashDrift = 45;
         nStakeSplitThreshold = 2000;
         nHashInterval = 22;
-        nStakeSetUpdateTime = 300; // 5 minutes
 
         //MultiSend
         vMultiSend.clear();
@@ -7,6 +7,8 @@
 
 #include "walletdb.h"
 
+#include "accumulators.h"
+
 #include "base58.h"
 #include "protocol.h"
 #include "serialize.h"
@@ -1054,7 +1056,13 @@ bool CWalletDB::WriteZerocoinMint(const CZerocoinMint& zerocoinMint)
     uint256 hash = Hash(ss.begin(), ss.end());
 
     Erase(make_pair(string("zerocoin"), hash));
-    return Write(make_pair(string("zerocoin"), hash), zerocoinMint, true);
+    if (!Write(make_pair(string("zerocoin"), hash), zerocoinMint, true))
+        return false;
+
+    // A spent mint needs no witness anymore
+    if (zerocoinMint.IsUsed())
+        Erase(make_pair(string("zcwitness"), hash));
+    return true;
 }
 
 bool CWalletDB::ReadZerocoinMint(const CBigNum &bnPubCoinValue, CZerocoinMint& zerocoinMint)
@@ -1072,9 +1080,39 @@ bool CWalletDB::EraseZerocoinMint(const CZerocoinMint& zerocoinMint)
     ss << zerocoinMint.GetValue();
     uint256 hash = Hash(ss.begin(), ss.end());
 
+    Erase(make_pair(string("zcwitness"), hash));
     return Erase(make_pair(string("zerocoin"), hash));
 }
 
+bool CWalletDB::WriteAccumulatorWitness(const CBigNum& bnPubcoin, const CAccumulatorWitnessCache& witnessCache)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnPubcoin;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    nWalletDBUpdated++;
+    return Write(make_pair(string("zcwitness"), hash), witnessCache, true);
+}
+
+bool CWalletDB::ReadAccumulatorWitness(const CBigNum& bnPubcoin, CAccumulatorWitnessCache& witnessCache)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnPubcoin;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    return Read(make_pair(string("zcwitness"), hash), witnessCache);
+}
+
+bool CWalletDB::EraseAccumulatorWitness(const CBigNum& bnPubcoin)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnPubcoin;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    nWalletDBUpdated++;
+    return Erase(make_pair(string("zcwitness"), hash));
+}
+
 bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint)
 {
     CDataStream ss(SER_GETHASH, 0);
@@ -1090,6 +1128,7 @@ bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint)
         LogPrintf("%s : failed to erase orphaned zerocoin mint\n", __func__);
         return false;
     }
+    Erase(make_pair(string("zcwitness"), hash));
 
     return true;
 }
@@ -29,6 +29,7 @@ class CMasterKey;
 class CScript;
 class CWallet;
 class CWalletTx;
+class CAccumulatorWitnessCache;
 class CZerocoinMint;
 class CZerocoinSpend;
 class uint160;
@@ -164,6 +165,9 @@ public:
     bool WriteZerocoinSpendSerialEntry(const CZerocoinSpend& zerocoinSpend);
     bool EraseZerocoinSpendSerialEntry(const CBigNum& serialEntry);
     bool ReadZerocoinSpendSerialEntry(const CBigNum& bnSerial);
+    bool WriteAccumulatorWitness(const CBigNum& bnPubcoin, const CAccumulatorWitnessCache& witnessCache);
+    bool ReadAccumulatorWitness(const CBigNum& bnPubcoin, CAccumulatorWitnessCache& witnessCache);
+    bool EraseAccumulatorWitness(const CBigNum& bnPubcoin);
 
 private:
     CWalletDB(const CWalletDB&);
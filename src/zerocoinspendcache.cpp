@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zerocoinspendcache.h"
+
+#include "hash.h"
+#include "random.h"
+#include "util.h"
+#include "libzerocoin/CoinSpend.h"
+
+CZerocoinSpendCache zerocoinSpendCache;
+
+uint256 CZerocoinSpendCache::GetSpendHash(const libzerocoin::CoinSpend& spend)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << spend;
+    return ss.GetHash();
+}
+
+bool CZerocoinSpendCache::Get(const uint256& hashSpend, uint32_t nChecksum)
+{
+    bool fFound;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        fFound = setValid.count(spenddata_type(hashSpend, nChecksum)) > 0;
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs_statistics);
+    if (fFound)
+        nHits++;
+    else
+        nMisses++;
+    return fFound;
+}
+
+void CZerocoinSpendCache::Set(const uint256& hashSpend, uint32_t nChecksum)
+{
+    // A block holds at most a few hundred spends, so the default keeps
+    // several blocks worth of mempool verified spends at ~100 bytes each
+    int64_t nMaxCacheSize = GetArg("-maxspendcachesize", DEFAULT_MAX_SPEND_CACHE_SIZE);
+    if (nMaxCacheSize <= 0) return;
+
+    boost::unique_lock<boost::shared_mutex> lock(cs_spendcache);
+
+    while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize) {
+        // Evict a random entry, for the same reason as the signature cache:
+        // it foils attackers trying to flush specific spends out of the cache
+        uint256 randomHash = GetRandHash();
+        std::set<spenddata_type>::iterator it = setValid.lower_bound(spenddata_type(randomHash, 0));
+        if (it == setValid.end())
+            it = setValid.begin();
+        setValid.erase(it);
+    }
+
+    setValid.insert(spenddata_type(hashSpend, nChecksum));
+}
+
+void CZerocoinSpendCache::Clear()
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_spendcache);
+    setValid.clear();
+}
+
+void CZerocoinSpendCache::GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut, uint64_t& nSizeOut)
+{
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        nSizeOut = setValid.size();
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs_statistics);
+    nHitsOut = nHits;
+    nMissesOut = nMisses;
+}
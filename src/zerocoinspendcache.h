@@ -0,0 +1,56 @@
+// Copyright (c) 2018 The OPCX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef OPCX_ZEROCOINSPENDCACHE_H
+#define OPCX_ZEROCOINSPENDCACHE_H
+
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <utility>
+
+#include <boost/thread/shared_mutex.hpp>
+
+namespace libzerocoin
+{
+class CoinSpend;
+}
+
+/** Default for -maxspendcachesize, number of verified zerocoin spends kept in memory */
+static const int64_t DEFAULT_MAX_SPEND_CACHE_SIZE = 5000;
+
+/**
+ * Valid zerocoin spend cache, to avoid doing the expensive CoinSpend::Verify
+ * twice for every spend (once when accepted into memory pool, and again when
+ * the block containing it is checked). Only the proof is cached, callers
+ * still check that the accumulator checksum is known before a lookup.
+ */
+class CZerocoinSpendCache
+{
+private:
+    //! spenddata_type is (hash of the serialized spend, accumulator checksum):
+    typedef std::pair<uint256, uint32_t> spenddata_type;
+    std::set<spenddata_type> setValid;
+    boost::shared_mutex cs_spendcache;
+
+    //! Lookup statistics, only touched while holding cs_statistics
+    boost::mutex cs_statistics;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+public:
+    CZerocoinSpendCache() : nHits(0), nMisses(0) {}
+
+    static uint256 GetSpendHash(const libzerocoin::CoinSpend& spend);
+
+    bool Get(const uint256& hashSpend, uint32_t nChecksum);
+    void Set(const uint256& hashSpend, uint32_t nChecksum);
+    void Clear();
+
+    void GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut, uint64_t& nSizeOut);
+};
+
+extern CZerocoinSpendCache zerocoinSpendCache;
+
+#endif //OPCX_ZEROCOINSPENDCACHE_H